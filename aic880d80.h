@@ -14,6 +14,15 @@
 
 #include <linux/types.h>
 #include <linux/bitops.h>
+#include <linux/cache.h>
+#include <linux/io.h>
+#include <linux/pci.h>
+#include <linux/netdevice.h>
+#include <linux/workqueue.h>
+#include <linux/interrupt.h>
+#include <linux/log2.h>
+#include <linux/sizes.h>
+#include <linux/seq_file.h>
 
 /* Hardware identification */
 #define AIC880D80_VENDOR_ID     0x1AE0  /* AIC semiconductor vendor ID */
@@ -57,11 +66,97 @@
 #define AIC880D80_REG_TX_DESC_LEN   0x05C   /* TX descriptor count */
 
 /* Queue Management */
+/*
+ * RX_TAIL is the driver's producer index: the device never fetches the
+ * descriptor at or beyond it. Lowering it retracts descriptors the device
+ * has not fetched yet; RX_HEAD then reports how far it got.
+ */
 #define AIC880D80_REG_RX_HEAD       0x060   /* RX queue head pointer */
 #define AIC880D80_REG_RX_TAIL       0x064   /* RX queue tail pointer */
 #define AIC880D80_REG_TX_HEAD       0x068   /* TX queue head pointer */
 #define AIC880D80_REG_TX_TAIL       0x06C   /* TX queue tail pointer */
 
+/*
+ * Per-ring TX registers, one block per hardware TX ring. Ring 0 aliases
+ * the legacy TX_DESC_* / TX_HEAD / TX_TAIL registers above.
+ */
+#define AIC880D80_REG_TXQ_BASE      0x200
+#define AIC880D80_REG_TXQ_STRIDE    0x20
+#define AIC880D80_REG_TXQ(q, off)   \
+    (AIC880D80_REG_TXQ_BASE + (q) * AIC880D80_REG_TXQ_STRIDE + (off))
+#define AIC880D80_TXQ_DESC_LO       0x00    /* Descriptor base low */
+#define AIC880D80_TXQ_DESC_HI       0x04    /* Descriptor base high */
+#define AIC880D80_TXQ_DESC_LEN      0x08    /* Descriptor count */
+#define AIC880D80_TXQ_HEAD          0x0C    /* Head pointer */
+#define AIC880D80_TXQ_TAIL          0x10    /* Tail pointer (doorbell) */
+#define AIC880D80_TXQ_WEIGHT        0x14    /* WRR weight, 1-255 */
+#define AIC880D80_TXQ_CTRL          0x18    /* Per-ring control */
+#define AIC880D80_TXQ_CTRL_LAUNCH   BIT(0)  /* Honour descriptor launch time */
+
+/*
+ * Low-latency TX push, a write-combining window per TX ring in BAR2. A
+ * push block is a descriptor followed by the first bytes of the frame;
+ * it moves the ring tail past the pushed slot like a TAIL doorbell, but
+ * the device takes the descriptor and the inline bytes from the block
+ * and only DMA-reads what follows them.
+ */
+#define AIC880D80_PUSH_BAR          2
+#define AIC880D80_PUSH_STRIDE       0x1000
+#define AIC880D80_PUSH_WINDOW(q)    ((q) * AIC880D80_PUSH_STRIDE)
+#define AIC880D80_PUSH_INLINE_MAX   128     /* Frame bytes per push block */
+
+/* Statistics DMA Engine */
+#define AIC880D80_REG_STATS_DMA_LO  0x070   /* Stats snapshot base low */
+#define AIC880D80_REG_STATS_DMA_HI  0x074   /* Stats snapshot base high */
+#define AIC880D80_REG_STATS_DMA_CTRL 0x078  /* Stats snapshot control */
+
+/* TX Scheduler */
+#define AIC880D80_REG_TX_SCHED      0x080   /* TX ring arbitration */
+
+/* RX address filtering, all filter registers reset to zero */
+#define AIC880D80_REG_RX_FILTER     0x0A0   /* RX filter mode */
+#define AIC880D80_REG_UC_HASH_LO    0x0A8   /* Unicast hash bins 0-31 */
+#define AIC880D80_REG_UC_HASH_HI    0x0AC   /* Unicast hash bins 32-63 */
+#define AIC880D80_REG_MC_HASH_LO    0x0B0   /* Multicast hash bins 0-31 */
+#define AIC880D80_REG_MC_HASH_HI    0x0B4   /* Multicast hash bins 32-63 */
+
+/*
+ * Perfect-match table, one LO/HI pair per entry, laid out like MAC_ADDR.
+ * An entry only matches while HI has VALID set, so write LO first and HI
+ * last and a half-written entry never matches.
+ */
+#define AIC880D80_REG_PFILT_LO(i)   (0x300 + (i) * 8)
+#define AIC880D80_REG_PFILT_HI(i)   (0x304 + (i) * 8)
+#define AIC880D80_PFILT_VALID       BIT(31)
+
+/*
+ * Striding (multi-packet) RX. With RX_MPRQ_ENABLE every RX descriptor
+ * posts one large buffer cut into fixed strides, and the device packs
+ * consecutive frames into consecutive strides of the buffer at RX_HEAD.
+ * Frames are reported through a separate completion queue instead of
+ * descriptor writeback: one entry per frame, carrying its first stride
+ * and stride count. A frame never straddles buffers; when the next one
+ * does not fit, the device closes the buffer with a zero-length filler
+ * entry. The entry that closes a buffer has BUF_DONE set and is the
+ * last one for it, and buffers are closed in ring order. The device
+ * flips PHASE every pass over the queue and never writes the entry
+ * before RX_CQ_HEAD. The descriptor length word is not used, buffers
+ * are STRIDES << STRIDE_SHIFT bytes.
+ */
+#define AIC880D80_REG_RX_MPRQ       0x0B8   /* Striding RX control */
+#define AIC880D80_REG_RX_CQ_LO      0x0C0   /* RX completion queue base low */
+#define AIC880D80_REG_RX_CQ_HI      0x0C4   /* RX completion queue base high */
+#define AIC880D80_REG_RX_CQ_LEN     0x0C8   /* RX completion queue entries */
+#define AIC880D80_REG_RX_CQ_HEAD    0x0CC   /* Driver consumer index */
+#define AIC880D80_REG_RX_CQ_TAIL    0x0D0   /* Device producer index */
+#define AIC880D80_RX_MPRQ_ENABLE    BIT(0)
+#define AIC880D80_RX_MPRQ_STRIDE_SHIFT GENMASK(11, 8)   /* log2 of stride bytes */
+#define AIC880D80_RX_MPRQ_STRIDES   GENMASK(31, 16)     /* Strides per buffer */
+
+/* Launch-time clock, free running ns; reading LO latches HI */
+#define AIC880D80_REG_SYSTIME_LO    0x090
+#define AIC880D80_REG_SYSTIME_HI    0x094
+
 /* ARM64 Specific Optimizations */
 #define AIC880D80_REG_ARM64_CTRL    0x100   /* ARM64 optimization control */
 #define AIC880D80_REG_CACHE_CTRL    0x104   /* Cache coherency control */
@@ -93,6 +188,16 @@
 #define AIC880D80_STATUS_TX_ACTIVE  BIT(9)  /* TX active */
 #define AIC880D80_STATUS_DMA_ACTIVE BIT(10) /* DMA active */
 
+/* MAC Control Bits */
+#define AIC880D80_MAC_CTRL_LOOPBACK BIT(0)  /* Internal MAC loopback */
+
+/* RX Filter Bits */
+#define AIC880D80_RX_FILTER_PROMISC  BIT(0) /* Accept all frames */
+#define AIC880D80_RX_FILTER_ALLMULTI BIT(1) /* Accept all multicast */
+#define AIC880D80_RX_FILTER_BCAST    BIT(2) /* Accept broadcast */
+#define AIC880D80_RX_FILTER_UC_HASH  BIT(3) /* Match unicast against UC_HASH */
+#define AIC880D80_RX_FILTER_MC_HASH  BIT(4) /* Match multicast against MC_HASH */
+
 /* Interrupt Bits */
 #define AIC880D80_INT_RX_DONE       BIT(0)  /* RX completion */
 #define AIC880D80_INT_TX_DONE       BIT(1)  /* TX completion */
@@ -115,6 +220,16 @@
 #define AIC880D80_DMA_BURST_8       (0x3 << 8)  /* 8-word burst */
 #define AIC880D80_DMA_BURST_16      (0x4 << 8)  /* 16-word burst */
 #define AIC880D80_DMA_BURST_32      (0x5 << 8)  /* 32-word burst */
+#define AIC880D80_DMA_BURST(words)  ((ilog2(words) & 0xF) << 8)
+#define AIC880D80_DMA_BURST_WORDS(reg) \
+    (1U << (((reg) & AIC880D80_DMA_BURST_MASK) >> 8))
+
+/* Statistics DMA Control Bits */
+#define AIC880D80_STATS_DMA_ENABLE  BIT(0)  /* Periodic snapshot enable */
+#define AIC880D80_STATS_DMA_PERIOD_SHIFT 16 /* Snapshot period in ms */
+#define AIC880D80_STATS_DMA_PERIOD_MASK  (0xFFFF << 16)
+#define AIC880D80_STATS_DMA_PERIOD_MS    500     /* Default snapshot period */
+#define AIC880D80_STATS_READ_RETRIES     4       /* Torn snapshot retries */
 
 /* ARM64 Cache Control Bits */
 #define AIC880D80_CACHE_COHERENT    BIT(0)  /* Cache coherent */
@@ -123,14 +238,28 @@
 #define AIC880D80_CACHE_PREFETCH    BIT(3)  /* Enable prefetch */
 #define AIC880D80_CACHE_WRITEBACK   BIT(4)  /* Writeback cache */
 
+/* Prefetch Control Bits */
+#define AIC880D80_PREFETCH_DESC     BIT(0)  /* Prefetch descriptors */
+#define AIC880D80_PREFETCH_DATA     BIT(1)  /* Prefetch packet data */
+
 /* Descriptor Flags */
 #define AIC880D80_DESC_OWN          BIT(31) /* Descriptor owned by hardware */
 #define AIC880D80_DESC_EOP          BIT(30) /* End of packet */
 #define AIC880D80_DESC_SOP          BIT(29) /* Start of packet */
-#define AIC880D80_DESC_INT          BIT(28) /* Generate interrupt */
+#define AIC880D80_DESC_INT          BIT(28) /* TX: write back and interrupt on completion */
 #define AIC880D80_DESC_ERR          BIT(27) /* Error occurred */
+#define AIC880D80_DESC_LAUNCH       BIT(26) /* TX: hold until launch_lo/hi */
+#define AIC880D80_DESC_USO          BIT(25) /* TX: segment UDP payload per seg */
+
+/* TX descriptor seg word (SOP descriptor, with DESC_USO) */
+#define AIC880D80_DESC_SEG_MSS      GENMASK(13, 0)  /* Payload bytes per segment */
+#define AIC880D80_DESC_SEG_HDRLEN   GENMASK(24, 16) /* L2-L4 header bytes */
 #define AIC880D80_DESC_LEN_MASK     0xFFFF  /* Length mask */
 
+/* TX descriptor push word, only meaningful inside a push block */
+#define AIC880D80_DESC_PUSH_SLOT    GENMASK(15, 0)  /* Ring slot of the descriptor */
+#define AIC880D80_DESC_PUSH_INLINE  GENMASK(23, 16) /* Frame bytes after it */
+
 /* Buffer and Ring Sizes */
 #define AIC880D80_MAX_FRAME_SIZE    9216    /* Maximum frame size */
 #define AIC880D80_MIN_FRAME_SIZE    64      /* Minimum frame size */
@@ -140,6 +269,72 @@
 #define AIC880D80_TX_RING_SIZE      256     /* TX descriptor ring size */
 #define AIC880D80_MAX_RX_RINGS      8       /* Maximum RX rings */
 #define AIC880D80_MAX_TX_RINGS      8       /* Maximum TX rings */
+#define AIC880D80_MIN_RING_SIZE     64      /* Minimum configurable ring */
+#define AIC880D80_MAX_RING_SIZE     1024    /* Maximum configurable ring */
+#define AIC880D80_MIN_RX_BUFFER_SIZE 1536   /* Must hold a full 1500 MTU frame */
+
+/* DMA Calibration (loopback throughput measurement) */
+#define AIC880D80_CALIB_FRAMES      512     /* Frames per measurement */
+#define AIC880D80_CALIB_FRAME_LEN   1514    /* Bytes per frame */
+#define AIC880D80_CALIB_TIMEOUT_US  100000  /* Per-measurement timeout */
+#define AIC880D80_CALIB_POLL_US     10      /* Sleep between throughput polls */
+#define AIC880D80_LATENCY_FRAMES    64      /* Frames per latency self-test */
+
+/* NEON copy/checksum fallbacks */
+#if defined(AIC880D80_USE_NEON_OPTIMIZATION) && IS_ENABLED(CONFIG_KERNEL_MODE_NEON)
+#define AIC880D80_HAVE_NEON
+#endif
+#define AIC880D80_NEON_MIN_LEN      128     /* Below this FPSIMD save/restore dominates */
+#define AIC880D80_RX_COPYBREAK      256     /* Copy RX frames up to this size */
+#define AIC880D80_RX_HEADROOM       (NET_SKB_PAD + NET_IP_ALIGN)
+#define AIC880D80_TX_COPYBREAK      256     /* DMA pool: copy TX frames up to this size */
+
+/* Striding RX */
+#define AIC880D80_MPRQ_BUF_SIZE     SZ_32K  /* Bytes per descriptor, fits DESC_LEN */
+#define AIC880D80_MPRQ_BUF_ORDER    get_order(AIC880D80_MPRQ_BUF_SIZE)
+#define AIC880D80_MPRQ_RING_SIZE    16      /* Descriptors, replaces rx_ring_size */
+#define AIC880D80_MPRQ_CQ_SIZE      4096    /* Completion queue entries */
+#define AIC880D80_MPRQ_STRIDE       256     /* Default stride bytes */
+#define AIC880D80_MPRQ_STRIDE_MIN   64
+#define AIC880D80_MPRQ_STRIDE_MAX   2048
+#define AIC880D80_RX_HDR_LEN        256     /* Striding RX: headers copied to the skb */
+
+/* RX refill watermarks (defaults; 0 in priv means "derive from ring size") */
+#define AIC880D80_RX_REFILL_BATCH   32      /* Buffers per refill step */
+
+/* RX address filter sizes */
+#define AIC880D80_NUM_PERFECT_FILTERS 32    /* Perfect-match entries */
+#define AIC880D80_FILTER_HASH_BINS  64      /* Bins per hash, top CRC32 bits */
+
+/* TX Scheduler Bits */
+#define AIC880D80_TX_SCHED_WRR      BIT(0)  /* Weighted round robin, else strict */
+#define AIC880D80_TX_SCHED_RINGS_SHIFT 8    /* Active rings - 1 */
+#define AIC880D80_TX_SCHED_RINGS_MASK (0x3 << AIC880D80_TX_SCHED_RINGS_SHIFT)
+
+/* TX Rings / Traffic Classes (strict priority: highest ring first) */
+#define AIC880D80_MAX_TX_QUEUES     4
+#define AIC880D80_TX_WEIGHT_MAX     255
+
+/* TX Ring Flow Control */
+#define AIC880D80_TX_DESC_RESERVE   (MAX_SKB_FRAGS + 1) /* Worst-case packet */
+#define AIC880D80_TX_WAKE_THRESH    (2 * AIC880D80_TX_DESC_RESERVE)
+
+/* TX completion reporting (DESC_INT), see aic880d80_tx.c */
+#define AIC880D80_TX_INT_DESC       32      /* Default descriptors per report */
+#define AIC880D80_TX_INT_DESC_MAX   256
+#define AIC880D80_TX_INT_FILL_SHIFT 2       /* Report every frame below size/4 free */
+
+/* TX Hang Detection and Recovery */
+#define AIC880D80_TX_TIMEOUT        (5 * HZ) /* Stack TX watchdog timeout */
+#define AIC880D80_TX_HANG_TICKS     3       /* Watchdog ticks without TX progress */
+#define AIC880D80_TX_STOP_POLL_US   10      /* TX engine idle poll interval */
+#define AIC880D80_TX_STOP_TIMEOUT_US 2000   /* TX engine idle timeout */
+
+/* Driver State Bits (priv->state) */
+#define AIC880D80_STATE_DOWN        0       /* Interface is going down */
+#define AIC880D80_STATE_TX_RESET    1       /* TX queue reset in progress */
+#define AIC880D80_STATE_RX_SHRINK   2       /* NAPI to release idle RX buffers */
+#define AIC880D80_STATE_SUSPENDED   3       /* Quiesced for D3, rings kept */
 
 /* ARM64 Cache Line Sizes */
 #define AIC880D80_CACHE_LINE_SIZE   64      /* Default ARM64 cache line */
@@ -151,9 +346,25 @@ struct aic880d80_desc {
     __le32 length;      /* Buffer length */
     __le64 buffer_addr; /* Buffer physical address */
     __le32 vlan_tag;    /* VLAN tag */
-    __le32 reserved[3]; /* Reserved for future use */
+    __le32 launch_lo;   /* TX launch time, SYSTIME ns (DESC_LAUNCH) */
+    __le32 launch_hi;
+    __le32 seg;         /* TX USO: MSS and header length */
+    __le32 push;        /* TX push block: slot and inline length */
 } __packed __aligned(AIC880D80_CACHE_LINE_SIZE);
 
+/* Striding RX completion queue entry */
+struct aic880d80_rx_cqe {
+    __le32 status;      /* AIC880D80_CQE_* */
+    __le16 length;      /* Frame bytes, 0 for a filler */
+    __le16 stride;      /* First stride of the frame */
+    __le16 strides;     /* Strides used, including the filler tail */
+    __le16 reserved[3];
+} __packed;
+
+#define AIC880D80_CQE_PHASE         BIT(31) /* Flips every pass over the queue */
+#define AIC880D80_CQE_BUF_DONE      BIT(30) /* Last entry for the buffer at RX tail */
+#define AIC880D80_CQE_ERR           BIT(27) /* Frame received with an error */
+
 /* Statistics Structure */
 struct aic880d80_stats {
     u64 rx_packets;
@@ -176,6 +387,24 @@ struct aic880d80_stats {
     u64 tx_compressed;
 };
 
+/*
+ * Hardware Statistics Snapshot - written by the device every
+ * AIC880D80_STATS_DMA_PERIOD_MS. The device makes the generation odd
+ * while it updates the counters and even once the snapshot is complete.
+ */
+struct aic880d80_hw_stats_block {
+    __le32 generation;
+    __le32 reserved;
+    __le64 rx_crc_errors;
+    __le64 rx_length_errors;
+    __le64 rx_fifo_errors;
+    __le64 tx_fifo_errors;
+    __le64 rx_missed_errors;
+    __le64 tx_aborted_errors;
+    __le64 tx_carrier_errors;
+    __le64 tx_window_errors;
+} __aligned(AIC880D80_CACHE_LINE_SIZE);
+
 /* Hardware Features */
 #define AIC880D80_FEATURE_CSUM      BIT(0)  /* Hardware checksum */
 #define AIC880D80_FEATURE_TSO       BIT(1)  /* TCP segmentation offload */
@@ -190,6 +419,7 @@ struct aic880d80_stats {
 #define AIC880D80_PM_D1             1       /* Low power */
 #define AIC880D80_PM_D2             2       /* Lower power */
 #define AIC880D80_PM_D3             3       /* Lowest power */
+#define AIC880D80_RUNTIME_SUSPEND_MS 5000   /* Link down this long: runtime D3 */
 
 /* Debug and Error Codes */
 #define AIC880D80_ERR_TIMEOUT       -1
@@ -198,7 +428,277 @@ struct aic880d80_stats {
 #define AIC880D80_ERR_INVALID_PARAM -4
 #define AIC880D80_ERR_HW_FAILURE    -5
 
-/* Inline accessors for register read/write */
+/* Per-slot buffer state, one entry per descriptor */
+struct aic880d80_buffer_info {
+    struct sk_buff *skb;    /* TX: set on the last slot of a packet */
+    dma_addr_t dma;
+    u32 len;                /* Mapped length, 0 when unmapped */
+    u32 bytecount;          /* TX: wire bytes of the packet (last slot) */
+    u16 segs;               /* TX: wire frames of the packet (last slot) */
+    bool frag;              /* TX: page fragment mapping */
+    bool report;            /* TX: carries DESC_INT, reclaim stops here */
+    void *pool_va;          /* TX: DMA pool bounce slot, or NULL */
+    dma_addr_t pool_dma;
+    struct page *page;      /* RX: striding or page_pool buffer */
+};
+
+/*
+ * Descriptor ring. Fields are grouped by the CPU that writes them: the
+ * producer (xmit for TX, refill for RX) and the consumer (completion for
+ * TX, receive for RX) each own a cache line, so the two sides never pull
+ * the same line back and forth. scripts/check-layout.sh verifies this.
+ */
+struct aic880d80_ring {
+    /* Read-mostly, fixed while the ring is up */
+    struct aic880d80_desc *desc;
+    struct aic880d80_buffer_info *buf;
+    struct aic880d80_private *priv;
+    dma_addr_t desc_dma;
+    u32 size;
+    u32 queue_index;
+    int node;
+    void __iomem *push; /* TX: write-combining push window, or NULL */
+    struct aic880d80_rx_cqe *cqe;   /* RX: striding completion queue, or NULL */
+    dma_addr_t cqe_dma;
+
+    /* Producer side */
+    u32 head ____cacheline_aligned_in_smp;
+    u64 dropped;
+    u64 stops;          /* TX: times the queue ran out of descriptors */
+    u64 uso_packets;    /* TX: USO super-packets handed to the device */
+    u64 uso_segs;       /* TX: segments the device produced from them */
+    u64 pushes;         /* TX: frames sent through the push window */
+    u32 since_report;   /* TX: descriptors queued since the last DESC_INT */
+    u64 reports;        /* TX: completions requested with DESC_INT */
+    u64 dma_maps;       /* TX: per-packet streaming mappings */
+    u64 pool_copies;    /* TX: frames copied into a DMA pool slot */
+
+    /* Consumer side */
+    u32 tail ____cacheline_aligned_in_smp;
+    u64 packets;
+    u64 bytes;
+    u64 dma_unmaps;     /* TX */
+    u32 cq_head;        /* RX striding: next completion entry */
+    u32 cq_phase;       /* RX striding: PHASE of valid entries */
+    u32 mprq_stride;    /* RX striding: strides used in the tail buffer */
+    bool mprq_copy;     /* RX striding: below the low watermark, copy frames */
+} ____cacheline_aligned_in_smp;
+
+static inline u32 aic880d80_ring_next(const struct aic880d80_ring *ring, u32 idx)
+{
+    return ++idx == ring->size ? 0 : idx;
+}
+
+/* Per traffic class TX counters, folded in when the rings are freed */
+struct aic880d80_tc_stats {
+    u64 packets;
+    u64 bytes;
+    u64 dropped;
+    u64 stops;
+    u64 uso_packets;
+    u64 uso_segs;
+    u64 pushes;
+    u64 reports;
+    u64 dma_maps;
+    u64 dma_unmaps;
+    u64 pool_copies;
+};
+
+struct aic880d80_emu;
+struct aic880d80_pool;
+struct page_pool;
+
+/* Wakes the emulated engine; register writes are its doorbells */
+void aic880d80_emu_kick(struct aic880d80_emu *emu);
+
+/* Private device structure */
+struct aic880d80_private {
+    /* Hot, read-mostly datapath state */
+    struct net_device *netdev;
+    struct pci_dev *pdev;       /* NULL for the emulated backend */
+    struct device *dev;         /* DMA and devres device */
+    void __iomem *iobase;
+    struct aic880d80_emu *emu;  /* Emulated loopback backend, NULL on hardware */
+    void __iomem *push_base;    /* BAR2 push windows, NULL if absent */
+    u32 priv_flags;             /* AIC880D80_PRIV_FLAG_* */
+    u32 tx_int_desc;            /* TX completion reported every N descriptors */
+    struct aic880d80_ring *rx_ring;
+    struct aic880d80_ring *tx_ring[AIC880D80_MAX_TX_QUEUES];
+    u32 num_tx_rings;
+    unsigned long state;
+
+    /* NAPI */
+    struct napi_struct napi;
+    spinlock_t int_mask_lock;   /* INT_MASK read-modify-write, IRQ vs poll */
+
+    /*
+     * Statistics, ring counters are folded in when the rings are freed
+     * and the MAC/PHY snapshot when the stats block is
+     */
+    struct aic880d80_stats hw_stats;
+    struct aic880d80_hw_stats_block *stats_block;
+    dma_addr_t stats_block_dma;
+    u64 hw_stats_torn;          /* Snapshots still torn after the retries */
+
+    /* Work queues */
+    struct work_struct reset_work;
+    struct delayed_work watchdog_work;
+
+    /* TX hang detection and per-queue recovery */
+    unsigned long tx_reset_pending;
+    u32 tx_hang_last_tail[AIC880D80_MAX_TX_QUEUES];
+    u32 tx_hang_ticks[AIC880D80_MAX_TX_QUEUES];
+    u64 tx_timeouts;
+    u64 tx_queue_resets;
+    u64 tx_reset_failures;
+    u64 tx_recovery_last_ns;
+    u64 tx_recovery_max_ns;
+    u64 tx_recovery_total_ns;
+
+    /* mqprio: one TX ring per traffic class */
+    u8 num_tc;
+    u32 tx_sched;       /* AIC880D80_REG_TX_SCHED value */
+    u8 tx_weight[AIC880D80_MAX_TX_QUEUES];
+    struct aic880d80_tc_stats tc_stats[AIC880D80_MAX_TX_QUEUES];
+
+    /*
+     * L2 forwarding offload: macvlan stations by TX ring, [0] is ours.
+     * Changed under rtnl while NAPI runs, so the RX path reads both with
+     * READ_ONCE(); a station is cleared and RX synchronised before its
+     * ring is detached.
+     */
+    struct net_device *fwd_station[AIC880D80_MAX_TX_QUEUES];
+    u32 num_fwd;
+    u64 fwd_rx_steered;
+
+    /* ETF launch-time offload */
+    unsigned long tx_launch_queues;     /* Rings with launch time enabled */
+    s64 launch_offset_ns;               /* CLOCK_TAI - SYSTIME */
+
+    /* Power management: rings and mapped RX buffers survive D3 */
+    u64 pm_resume_start_ns;     /* Set on resume, cleared by the first RX frame */
+    u64 pm_suspends;
+    u64 pm_resume_ns;           /* Last resume callback duration */
+    u64 pm_first_rx_ns;         /* Last resume-to-first-RX-frame latency */
+    u64 pm_first_rx_max_ns;
+
+    /* ARM64 specific optimizations */
+    bool arm64_coherent_dma;
+    u32 arm64_cache_line_size;
+    bool neon_available;
+    u32 rx_copybreak;
+    u64 rx_copybreak_pkts;
+    u64 tx_sw_csum;
+
+    /*
+     * RX refill: keep rx_fill_target buffers posted, topping up in
+     * rx_refill_batch steps. The shrinker drops the target to
+     * rx_refill_low; falling below it (traffic) restores rx_refill_high.
+     */
+    u32 rx_refill_low;
+    u32 rx_refill_high;
+    u32 rx_refill_batch;
+    u32 rx_fill_target;
+    u32 rx_posted;              /* Snapshot for the shrinker */
+    struct shrinker *rx_shrinker;
+    u64 rx_shrinks;
+    u64 rx_bufs_released;
+    u64 rx_regrows;
+
+    /*
+     * DMA pool mode: RX pages from a page_pool and TX bounce slots carved
+     * from chunks mapped once, see aic880d80_pool.c. The map/unmap
+     * counters cover the streaming mappings that remain, so the two
+     * modes can be compared.
+     */
+    bool dma_pool;              /* Use the pools when the rings are set up */
+    u32 tx_copybreak;           /* TX bounce slot size, 0 = no TX slots */
+    struct aic880d80_pool *pool;
+    struct page_pool *rx_pp;    /* RX pages, unless striding RX is on */
+    u64 pool_chunk_maps;
+    u64 rx_dma_maps;
+    u64 rx_dma_unmaps;
+
+    /* Striding RX: AIC880D80_MPRQ_RING_SIZE buffers of rx_mprq_stride strides */
+    bool rx_mprq;
+    u32 rx_mprq_stride;
+    u64 rx_mprq_recycled;       /* Buffers reposted without a new mapping */
+    u64 rx_mprq_pinned;         /* Buffers left to skbs holding strides */
+    u64 rx_mprq_fillers;
+
+    /*
+     * RX address filter, a shadow of what is programmed so set_rx_mode()
+     * only writes the entries and registers that change. Serialised by
+     * netif_addr_lock.
+     */
+    u8 rx_filter_addr[AIC880D80_NUM_PERFECT_FILTERS][ETH_ALEN];
+    DECLARE_BITMAP(rx_filter_used, AIC880D80_NUM_PERFECT_FILTERS);
+    u32 rx_filter;      /* AIC880D80_REG_RX_FILTER value */
+    u64 rx_uc_hash;
+    u64 rx_mc_hash;
+    u64 rx_filter_writes;
+
+    /* Hardware features */
+    u32 features;
+    u32 max_frame_size;
+
+    /* Probe-time configuration: module parameter, then DT, then default */
+    u32 rx_ring_size;
+    u32 tx_ring_size;
+    u32 rx_buf_size;
+    u32 dma_burst;      /* AIC880D80_DMA_BURST_* encoding */
+    u32 cache_ctrl;     /* AIC880D80_REG_CACHE_CTRL value */
+    u32 prefetch_ctrl;  /* AIC880D80_REG_PREFETCH value */
+
+    /* Link state */
+    bool link_up;
+    u32 link_speed;
+    bool full_duplex;
+
+    /* Interrupt management */
+    int irq;
+    char irq_name[32];
+
+    /* NUMA placement */
+    int numa_node;      /* Node of the PCIe root port */
+    int irq_cpu;        /* CPU servicing the queue interrupt */
+    int ring_node;      /* Node holding rings, arrays and RX buffers */
+
+    /* Debugfs */
+    struct dentry *debugfs_dir;
+
+    /* Message level */
+    u32 msg_enable;
+};
+
+/* ethtool private flags */
+#define AIC880D80_PRIV_FLAG_TX_PUSH BIT(0)  /* Push small frames via BAR2 */
+
+/*
+ * MMIO and DMA ordering contract
+ *
+ * aic880d80_read32()/write32() are readl()/writel(): the write is ordered
+ * after every earlier store to memory, the read before every later load.
+ * They are needed only where MMIO meets DMA memory:
+ *  - doorbells that publish descriptors (TXQ TAIL, RX_TAIL on refill),
+ *  - INT_STATUS in the interrupt handler, which gates the completion
+ *    paths' descriptor reads,
+ *  - RX_HEAD after an RX_TAIL retract, which gates freeing buffers,
+ *  - RX_CQ_HEAD, which hands completion entries back to the device.
+ * Everything else on the datapath (INT_MASK, INT_CLEAR, the retract
+ * itself, filter tables) uses the _relaxed variants. Accesses to the
+ * device stay in program order either way.
+ *
+ * Descriptor rings are coherent memory, ordered with dma_wmb()/dma_rmb():
+ *  - TX: the device prefetches ahead of TAIL and trusts OWN, so every
+ *    slot body is written before the SOP OWN bit, with a dma_wmb().
+ *  - RX refill: no per-slot barrier. The device never fetches at or past
+ *    RX_TAIL, and the writel() doorbell orders the whole batch.
+ *  - TX clean / RX receive: see OWN clear, dma_rmb(), then read the rest
+ *    of the descriptor and the buffer.
+ * The push window is write-combining: wmb() before the copy, io_stop_wc()
+ * after it.
+ */
 static inline u32 aic880d80_read32(struct aic880d80_private *priv, u32 reg)
 {
     return readl(priv->iobase + reg);
@@ -206,6 +706,20 @@ static inline u32 aic880d80_read32(struct aic880d80_private *priv, u32 reg)
 static inline void aic880d80_write32(struct aic880d80_private *priv, u32 reg, u32 val)
 {
     writel(val, priv->iobase + reg);
+    if (unlikely(priv->emu))
+        aic880d80_emu_kick(priv->emu);
+}
+
+static inline u32 aic880d80_read32_relaxed(struct aic880d80_private *priv, u32 reg)
+{
+    return readl_relaxed(priv->iobase + reg);
+}
+static inline void aic880d80_write32_relaxed(struct aic880d80_private *priv,
+                                             u32 reg, u32 val)
+{
+    writel_relaxed(val, priv->iobase + reg);
+    if (unlikely(priv->emu))
+        aic880d80_emu_kick(priv->emu);
 }
 
 /* MAC register aliases for compatibility */
@@ -228,4 +742,83 @@ static inline void aic880d80_write32(struct aic880d80_private *priv, u32 reg, u3
 #define AIC880D80_DESC_GET_LEN(desc) \
     (le32_to_cpu((desc)->length) & AIC880D80_DESC_LEN_MASK)
 
+/* Bytes posted with each RX descriptor */
+static inline u32 aic880d80_rx_desc_len(const struct aic880d80_private *priv)
+{
+    return priv->rx_mprq ? AIC880D80_MPRQ_BUF_SIZE : priv->rx_buf_size;
+}
+
+/* Functions shared between driver units */
+int aic880d80_probe_common(struct device *dev, struct pci_dev *pdev,
+                           void __iomem *iobase, struct aic880d80_emu *emu);
+void aic880d80_remove_common(struct device *dev);
+extern const struct dev_pm_ops aic880d80_pm_ops;
+netdev_tx_t aic880d80_start_xmit(struct sk_buff *skb, struct net_device *netdev);
+void aic880d80_clean_tx_ring(struct aic880d80_ring *tx);
+void aic880d80_clean_tx_rings(struct aic880d80_private *priv);
+bool aic880d80_unmap_tx_buffer(struct aic880d80_private *priv,
+                               struct aic880d80_buffer_info *bi);
+void aic880d80_alloc_rx_buffers(struct aic880d80_private *priv);
+int aic880d80_process_rx_ring(struct aic880d80_private *priv, int budget);
+irqreturn_t aic880d80_interrupt(int irq, void *dev_id);
+int aic880d80_napi_poll(struct napi_struct *napi, int budget);
+void aic880d80_set_ethtool_ops(struct net_device *netdev);
+int aic880d80_read_mac_address(struct aic880d80_private *priv, u8 *mac);
+void aic880d80_hw_set_dma_tuning(struct aic880d80_private *priv);
+void aic880d80_sync_launch_clock(struct aic880d80_private *priv);
+int aic880d80_calibrate_dma(struct aic880d80_private *priv);
+int aic880d80_loopback_latency(struct aic880d80_private *priv, u64 *doorbell_ns,
+                               u64 *push_ns);
+void aic880d80_tx_push(void __iomem *window, const struct aic880d80_desc *desc,
+                       u32 slot, const void *data, u32 inline_len);
+void aic880d80_set_rx_mode(struct net_device *netdev);
+void aic880d80_restore_rx_filter(struct aic880d80_private *priv);
+void aic880d80_dump_rx_filter(struct aic880d80_private *priv, struct seq_file *s);
+
+void aic880d80_read_hw_stats(struct aic880d80_private *priv,
+                             struct aic880d80_stats *stats);
+void aic880d80_fold_hw_stats(struct aic880d80_private *priv,
+                             const struct aic880d80_hw_stats_block *blk);
+void aic880d80_update_link(struct aic880d80_private *priv);
+const struct cpumask *aic880d80_xps_cpus(int cpu);
+int aic880d80_rx_alloc_buffer(struct aic880d80_private *priv,
+                              struct aic880d80_buffer_info *bi, gfp_t gfp);
+void aic880d80_rx_free_buffer(struct aic880d80_private *priv,
+                              struct aic880d80_buffer_info *bi);
+int aic880d80_rx_pp_create(struct aic880d80_private *priv,
+                           struct aic880d80_ring *rx);
+void aic880d80_rx_pp_destroy(struct aic880d80_private *priv);
+void aic880d80_rx_shrink(struct aic880d80_private *priv);
+void aic880d80_rx_rearm(struct aic880d80_private *priv);
+int aic880d80_rx_shrinker_init(struct aic880d80_private *priv);
+void aic880d80_rx_shrinker_exit(struct aic880d80_private *priv);
+
+/* Copy/checksum with NEON when available (aic880d80_neon.c) */
+bool aic880d80_neon_detect(void);
+void aic880d80_copy(const struct aic880d80_private *priv, void *dst,
+                    const void *src, unsigned int len);
+__wsum aic880d80_csum(const struct aic880d80_private *priv, const void *buf,
+                      unsigned int len, __wsum sum);
+int aic880d80_tx_csum(struct aic880d80_private *priv, struct sk_buff *skb);
+void aic880d80_neon_bench(struct aic880d80_private *priv, struct seq_file *s);
+
+/* Raw NEON kernels, only between kernel_neon_begin()/end() (aic880d80_neon_inner.c) */
+void aic880d80_neon_copy(void *dst, const void *src, unsigned int len);
+__wsum aic880d80_neon_csum(const void *buf, unsigned int len, __wsum sum);
+
+/* Pre-mapped TX bounce pool (aic880d80_pool.c) */
+int aic880d80_pool_init(struct aic880d80_private *priv,
+                        struct aic880d80_ring *const *tx);
+void aic880d80_pool_free(struct aic880d80_private *priv);
+
+/* Emulated loopback backend (aic880d80_emu.c) */
+int aic880d80_emu_register(void);
+void aic880d80_emu_unregister(void);
+
+/* Debugfs (aic880d80_debugfs.c) */
+void aic880d80_debugfs_init(void);
+void aic880d80_debugfs_exit(void);
+void aic880d80_debugfs_register(struct aic880d80_private *priv);
+void aic880d80_debugfs_unregister(struct aic880d80_private *priv);
+
 #endif /* _AIC880D80_H_ */
@@ -0,0 +1,340 @@
+/*
+ * aic880d80_calib.c - DMA burst/prefetch calibration for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "aic880d80.h"
+#include <linux/dma-mapping.h>
+#include <linux/etherdevice.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
+
+#define AIC880D80_CALIB_RING_LEN    (AIC880D80_CALIB_FRAMES + 1)
+#define AIC880D80_CALIB_DESC_BYTES  \
+    (sizeof(struct aic880d80_desc) * AIC880D80_CALIB_RING_LEN)
+
+struct aic880d80_calib {
+    struct aic880d80_desc *tx_desc;
+    struct aic880d80_desc *rx_desc;
+    dma_addr_t tx_desc_dma;
+    dma_addr_t rx_desc_dma;
+    void *buf;              /* TX frame followed by the RX landing buffer */
+    dma_addr_t buf_dma;
+};
+
+/* Candidate settings, every combination is measured */
+static const u32 aic880d80_calib_bursts[] = {
+    AIC880D80_DMA_BURST_4,
+    AIC880D80_DMA_BURST_8,
+    AIC880D80_DMA_BURST_16,
+    AIC880D80_DMA_BURST_32,
+};
+
+static const u32 aic880d80_calib_prefetch[] = {
+    0,
+    AIC880D80_PREFETCH_DESC,
+    AIC880D80_PREFETCH_DESC | AIC880D80_PREFETCH_DATA,
+};
+
+static void aic880d80_calib_free(struct aic880d80_private *priv,
+                                 struct aic880d80_calib *c)
+{
+    struct device *dev = priv->dev;
+
+    if (c->buf)
+        dma_free_coherent(dev, 2 * priv->rx_buf_size, c->buf, c->buf_dma);
+    if (c->rx_desc)
+        dma_free_coherent(dev, AIC880D80_CALIB_DESC_BYTES, c->rx_desc,
+                          c->rx_desc_dma);
+    if (c->tx_desc)
+        dma_free_coherent(dev, AIC880D80_CALIB_DESC_BYTES, c->tx_desc,
+                          c->tx_desc_dma);
+}
+
+static int aic880d80_calib_alloc(struct aic880d80_private *priv,
+                                 struct aic880d80_calib *c)
+{
+    struct device *dev = priv->dev;
+
+    c->tx_desc = dma_alloc_coherent(dev, AIC880D80_CALIB_DESC_BYTES,
+                                    &c->tx_desc_dma, GFP_KERNEL);
+    c->rx_desc = dma_alloc_coherent(dev, AIC880D80_CALIB_DESC_BYTES,
+                                    &c->rx_desc_dma, GFP_KERNEL);
+    c->buf = dma_alloc_coherent(dev, 2 * priv->rx_buf_size, &c->buf_dma,
+                                GFP_KERNEL);
+    if (!c->tx_desc || !c->rx_desc || !c->buf) {
+        aic880d80_calib_free(priv, c);
+        return -ENOMEM;
+    }
+
+    /* Broadcast frame so the loopback path never filters it */
+    eth_broadcast_addr(c->buf);
+    memset(c->buf + ETH_ALEN, 0x5a, AIC880D80_CALIB_FRAME_LEN - ETH_ALEN);
+    return 0;
+}
+
+static void aic880d80_calib_set_engines(struct aic880d80_private *priv, bool on)
+{
+    u32 ctrl = aic880d80_read32(priv, AIC880D80_REG_CTRL);
+
+    if (on)
+        ctrl |= AIC880D80_CTRL_ENABLE | AIC880D80_CTRL_RX_ENABLE |
+                AIC880D80_CTRL_TX_ENABLE;
+    else
+        ctrl &= ~(AIC880D80_CTRL_RX_ENABLE | AIC880D80_CTRL_TX_ENABLE);
+    aic880d80_write32(priv, AIC880D80_REG_CTRL, ctrl);
+}
+
+/*
+ * Fill both rings with AIC880D80_CALIB_FRAMES frames of frame_len bytes
+ * and point the device at them, engines on but TX_TAIL still at 0.
+ */
+static void aic880d80_calib_load(struct aic880d80_private *priv,
+                                 struct aic880d80_calib *c, u32 frame_len)
+{
+    dma_addr_t rx_buf = c->buf_dma + priv->rx_buf_size;
+    int i;
+
+    aic880d80_calib_set_engines(priv, false);
+
+    memset(c->tx_desc, 0, AIC880D80_CALIB_DESC_BYTES);
+    memset(c->rx_desc, 0, AIC880D80_CALIB_DESC_BYTES);
+    for (i = 0; i < AIC880D80_CALIB_FRAMES; i++) {
+        c->rx_desc[i].buffer_addr = cpu_to_le64(rx_buf);
+        AIC880D80_DESC_SET_LEN(&c->rx_desc[i], priv->rx_buf_size);
+        c->rx_desc[i].status = cpu_to_le32(AIC880D80_DESC_OWN);
+
+        c->tx_desc[i].buffer_addr = cpu_to_le64(c->buf_dma);
+        AIC880D80_DESC_SET_LEN(&c->tx_desc[i], frame_len);
+        c->tx_desc[i].status = cpu_to_le32(AIC880D80_DESC_OWN |
+                                           AIC880D80_DESC_SOP |
+                                           AIC880D80_DESC_EOP);
+    }
+
+    aic880d80_write32(priv, AIC880D80_REG_RX_DESC_LO, lower_32_bits(c->rx_desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_RX_DESC_HI, upper_32_bits(c->rx_desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_TX_DESC_LO, lower_32_bits(c->tx_desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_TX_DESC_HI, upper_32_bits(c->tx_desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_RX_DESC_LEN, AIC880D80_CALIB_RING_LEN);
+    aic880d80_write32(priv, AIC880D80_REG_TX_DESC_LEN, AIC880D80_CALIB_RING_LEN);
+    aic880d80_write32(priv, AIC880D80_REG_RX_HEAD, 0);
+    aic880d80_write32(priv, AIC880D80_REG_RX_TAIL, AIC880D80_CALIB_FRAMES);
+    aic880d80_write32(priv, AIC880D80_REG_TX_HEAD, 0);
+    aic880d80_write32(priv, AIC880D80_REG_TX_TAIL, 0);
+
+    aic880d80_calib_set_engines(priv, true);
+}
+
+/* Time one loopback pass of AIC880D80_CALIB_FRAMES frames */
+static int aic880d80_calib_run(struct aic880d80_private *priv,
+                               struct aic880d80_calib *c, u64 *ns)
+{
+    struct aic880d80_desc *last = &c->rx_desc[AIC880D80_CALIB_FRAMES - 1];
+    ktime_t start;
+    u32 status;
+    int ret;
+
+    aic880d80_calib_load(priv, c, AIC880D80_CALIB_FRAME_LEN);
+
+    /*
+     * A pass takes hundreds of microseconds at line rate, so sleeping
+     * between polls costs little precision, and a setting that stalls
+     * does not hold the CPU for the whole timeout.
+     */
+    start = ktime_get();
+    aic880d80_write32(priv, AIC880D80_REG_TX_TAIL, AIC880D80_CALIB_FRAMES);
+    ret = read_poll_timeout(le32_to_cpu, status,
+                            !(status & AIC880D80_DESC_OWN),
+                            AIC880D80_CALIB_POLL_US,
+                            AIC880D80_CALIB_TIMEOUT_US, false,
+                            READ_ONCE(last->status));
+    *ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    aic880d80_calib_set_engines(priv, false);
+    return ret;
+}
+
+/*
+ * Send minimum-size frames one at a time, each kicked by a TAIL doorbell
+ * or a push block, and average the kick-to-RX-writeback time.
+ */
+static int aic880d80_latency_run(struct aic880d80_private *priv,
+                                 struct aic880d80_calib *c, bool push, u64 *ns)
+{
+    void __iomem *window = priv->push_base + AIC880D80_PUSH_WINDOW(0);
+    u64 total = 0;
+    ktime_t start;
+    u32 status;
+    int i, ret = 0;
+
+    aic880d80_calib_load(priv, c, ETH_ZLEN);
+
+    for (i = 0; i < AIC880D80_LATENCY_FRAMES; i++) {
+        start = ktime_get();
+        if (push)
+            aic880d80_tx_push(window, &c->tx_desc[i], i, c->buf, ETH_ZLEN);
+        else
+            aic880d80_write32(priv, AIC880D80_REG_TX_TAIL, i + 1);
+        ret = read_poll_timeout_atomic(le32_to_cpu, status,
+                                       !(status & AIC880D80_DESC_OWN), 0,
+                                       AIC880D80_CALIB_TIMEOUT_US, false,
+                                       READ_ONCE(c->rx_desc[i].status));
+        if (ret)
+            break;
+        total += ktime_to_ns(ktime_sub(ktime_get(), start));
+    }
+    *ns = div_u64(total, AIC880D80_LATENCY_FRAMES);
+
+    aic880d80_calib_set_engines(priv, false);
+    return ret;
+}
+
+/* Polled MAC loopback with the DMA engines on; returns MAC_CTRL to restore */
+static u32 aic880d80_calib_enter(struct aic880d80_private *priv)
+{
+    u32 dma_ctrl, mac_ctrl;
+
+    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE, 0);
+    mac_ctrl = aic880d80_read32(priv, AIC880D80_REG_MAC_CTRL);
+    aic880d80_write32(priv, AIC880D80_REG_MAC_CTRL,
+                     mac_ctrl | AIC880D80_MAC_CTRL_LOOPBACK);
+
+    dma_ctrl = AIC880D80_DMA_ENABLE | AIC880D80_DMA_64BIT |
+               AIC880D80_DMA_RX_ENABLE | AIC880D80_DMA_TX_ENABLE;
+    if (priv->arm64_coherent_dma)
+        dma_ctrl |= AIC880D80_DMA_COHERENT;
+    aic880d80_write32(priv, AIC880D80_REG_DMA_CTRL, dma_ctrl);
+    return mac_ctrl;
+}
+
+/**
+ * aic880d80_calibrate_dma - Pick the fastest DMA burst/prefetch setting
+ * @priv: driver private data
+ *
+ * Runs a MAC loopback transfer for every burst length and prefetch
+ * combination and keeps the fastest in priv->dma_burst,
+ * priv->prefetch_ctrl and priv->cache_ctrl. The best setting differs
+ * between cores, so it is measured rather than hard-coded. The device is
+ * left with RX/TX disabled; open() resets and programs it from priv.
+ */
+int aic880d80_calibrate_dma(struct aic880d80_private *priv)
+{
+    const u64 bits = (u64)AIC880D80_CALIB_FRAMES * AIC880D80_CALIB_FRAME_LEN * 8;
+    u32 orig_burst = priv->dma_burst;
+    u32 orig_prefetch = priv->prefetch_ctrl;
+    u32 orig_cache = priv->cache_ctrl;
+    u32 best_burst = 0, best_prefetch = 0, mac_ctrl;
+    struct aic880d80_calib c = {};
+    u64 ns, best_ns = U64_MAX;
+    int b, p, ret;
+
+    ret = aic880d80_calib_alloc(priv, &c);
+    if (ret)
+        return ret;
+
+    mac_ctrl = aic880d80_calib_enter(priv);
+
+    for (b = 0; b < ARRAY_SIZE(aic880d80_calib_bursts); b++) {
+        for (p = 0; p < ARRAY_SIZE(aic880d80_calib_prefetch); p++) {
+            priv->dma_burst = aic880d80_calib_bursts[b];
+            priv->prefetch_ctrl = aic880d80_calib_prefetch[p];
+            priv->cache_ctrl = orig_cache & ~AIC880D80_CACHE_PREFETCH;
+            if (priv->prefetch_ctrl)
+                priv->cache_ctrl |= AIC880D80_CACHE_PREFETCH;
+            aic880d80_hw_set_dma_tuning(priv);
+
+            ret = aic880d80_calib_run(priv, &c, &ns);
+            if (ret) {
+                dev_dbg(priv->dev,
+                        "Calibration: burst %u prefetch %#x timed out\n",
+                        AIC880D80_DMA_BURST_WORDS(priv->dma_burst),
+                        priv->prefetch_ctrl);
+                continue;
+            }
+
+            dev_dbg(priv->dev,
+                    "Calibration: burst %u prefetch %#x: %llu Mbit/s\n",
+                    AIC880D80_DMA_BURST_WORDS(priv->dma_burst),
+                    priv->prefetch_ctrl, div64_u64(bits * 1000, ns ?: 1));
+
+            if (ns < best_ns) {
+                best_ns = ns;
+                best_burst = priv->dma_burst;
+                best_prefetch = priv->prefetch_ctrl;
+            }
+        }
+    }
+
+    aic880d80_write32(priv, AIC880D80_REG_MAC_CTRL, mac_ctrl);
+    aic880d80_calib_free(priv, &c);
+
+    if (best_ns == U64_MAX) {
+        dev_warn(priv->dev,
+                 "DMA calibration failed, keeping configured settings\n");
+        priv->dma_burst = orig_burst;
+        priv->prefetch_ctrl = orig_prefetch;
+        priv->cache_ctrl = orig_cache;
+        return -ETIMEDOUT;
+    }
+
+    priv->dma_burst = best_burst;
+    priv->prefetch_ctrl = best_prefetch;
+    priv->cache_ctrl = orig_cache & ~AIC880D80_CACHE_PREFETCH;
+    if (best_prefetch)
+        priv->cache_ctrl |= AIC880D80_CACHE_PREFETCH;
+
+    dev_info(priv->dev,
+             "DMA calibration: burst %u words, prefetch %#x, %llu Mbit/s\n",
+             AIC880D80_DMA_BURST_WORDS(best_burst), best_prefetch,
+             div64_u64(bits * 1000, best_ns ?: 1));
+    return 0;
+}
+
+/**
+ * aic880d80_loopback_latency - Measure doorbell vs push TX latency
+ * @priv: driver private data
+ * @doorbell_ns: mean per-frame latency kicked through TX_TAIL
+ * @push_ns: mean per-frame latency kicked through the push window, 0
+ *           when the device has none
+ *
+ * Uses the calibration loopback with the current DMA tuning and leaves
+ * the device the way aic880d80_calibrate_dma() does.
+ */
+int aic880d80_loopback_latency(struct aic880d80_private *priv, u64 *doorbell_ns,
+                               u64 *push_ns)
+{
+    struct aic880d80_calib c = {};
+    u32 mac_ctrl;
+    int ret;
+
+    *doorbell_ns = 0;
+    *push_ns = 0;
+
+    ret = aic880d80_calib_alloc(priv, &c);
+    if (ret)
+        return ret;
+
+    mac_ctrl = aic880d80_calib_enter(priv);
+    aic880d80_hw_set_dma_tuning(priv);
+
+    ret = aic880d80_latency_run(priv, &c, false, doorbell_ns);
+    if (!ret && priv->push_base)
+        ret = aic880d80_latency_run(priv, &c, true, push_ns);
+
+    aic880d80_write32(priv, AIC880D80_REG_MAC_CTRL, mac_ctrl);
+    aic880d80_calib_free(priv, &c);
+
+    if (ret) {
+        dev_warn(priv->dev, "Loopback latency test timed out\n");
+        return ret;
+    }
+
+    dev_info(priv->dev, "Loopback latency: doorbell %llu ns, push %llu ns\n",
+             *doorbell_ns, *push_ns);
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * aic880d80_debugfs.c - Debugfs support for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "aic880d80.h"
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/mm.h>
+#include <linux/pm_runtime.h>
+#include <linux/rtnetlink.h>
+#include <linux/sched/signal.h>
+#include <linux/topology.h>
+#include <linux/sched/topology.h>
+
+static struct dentry *aic880d80_debugfs_root;
+
+/* NUMA node backing a kmalloc'd or skb buffer */
+static int aic880d80_buf_node(const void *buf)
+{
+    return buf ? page_to_nid(virt_to_head_page(buf)) : NUMA_NO_NODE;
+}
+
+/*
+ * Posted RX buffers on the ring's node. NAPI frees the skbs it receives,
+ * so it is paused for the walk, with the device held out of runtime
+ * suspend, which would disable NAPI underneath.
+ */
+static int aic880d80_count_local_bufs(struct aic880d80_private *priv,
+                                      struct aic880d80_ring *rx,
+                                      u32 *local, u32 *posted)
+{
+    u32 i;
+    int ret;
+
+    ret = pm_runtime_resume_and_get(priv->dev);
+    if (ret)
+        return ret;
+    napi_disable(&priv->napi);
+
+    for (i = 0; i < rx->size; i++) {
+        const struct aic880d80_buffer_info *bi = &rx->buf[i];
+        int node;
+
+        /* Striding and page_pool buffers are pages, not skbs */
+        if (bi->skb)
+            node = aic880d80_buf_node(bi->skb->head);
+        else if (bi->page)
+            node = page_to_nid(bi->page);
+        else
+            continue;
+        (*posted)++;
+        if (node == rx->node)
+            (*local)++;
+    }
+
+    napi_enable(&priv->napi);
+    pm_runtime_put(priv->dev);
+    return 0;
+}
+
+/*
+ * Per-queue placement: the IRQ CPU, the node the queue was placed on and
+ * how many posted RX buffers actually landed on that node. The rings are
+ * allocated and freed under rtnl, by open/close, mqprio and macvlan
+ * offload, so it is held throughout.
+ */
+static int aic880d80_queues_show(struct seq_file *s, void *unused)
+{
+    struct aic880d80_private *priv = s->private;
+    struct aic880d80_ring *rx;
+    u32 q, local = 0, posted = 0;
+    int ret = 0;
+
+    /* close() removes this file under rtnl, waiting for readers */
+    if (!rtnl_trylock())
+        return restart_syscall();
+
+    rx = priv->rx_ring;
+    if (!rx)
+        goto out;
+    ret = aic880d80_count_local_bufs(priv, rx, &local, &posted);
+    if (ret)
+        goto out;
+
+    seq_printf(s, "device node: %d\n", priv->numa_node);
+    seq_printf(s, "irq cpu: %d, capacity %lu, xps cpus %*pbl\n", priv->irq_cpu,
+               arch_scale_cpu_capacity(priv->irq_cpu),
+               cpumask_pr_args(aic880d80_xps_cpus(priv->irq_cpu)));
+    seq_printf(s, "rx fill: %u posted, target %u (low %u, high %u, batch %u)\n",
+               READ_ONCE(priv->rx_posted), READ_ONCE(priv->rx_fill_target),
+               priv->rx_refill_low, priv->rx_refill_high,
+               priv->rx_refill_batch);
+    seq_puts(s, "queue  irq   cpu  node  ring_node  local_bufs\n");
+
+    seq_printf(s, "rx%-4u %-5d %-4d %-5d %-10d %u/%u\n",
+               rx->queue_index, priv->irq, priv->irq_cpu, rx->node,
+               aic880d80_buf_node(rx), local, posted);
+    for (q = 0; q < priv->num_tx_rings; q++) {
+        struct aic880d80_ring *tx = priv->tx_ring[q];
+
+        if (!tx)
+            continue;
+        seq_printf(s, "tx%-4u %-5d %-4d %-5d %-10d -\n",
+                   tx->queue_index, priv->irq, priv->irq_cpu, tx->node,
+                   aic880d80_buf_node(tx));
+    }
+
+out:
+    rtnl_unlock();
+    return ret;
+}
+DEFINE_SHOW_ATTRIBUTE(aic880d80_queues);
+
+/* Perfect-match entries, hash bins and filter mode as programmed */
+static int aic880d80_rx_filter_show(struct seq_file *s, void *unused)
+{
+    aic880d80_dump_rx_filter(s->private, s);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aic880d80_rx_filter);
+
+/* Generic vs NEON copy/checksum timings, computed on every read */
+static int aic880d80_neon_bench_show(struct seq_file *s, void *unused)
+{
+    aic880d80_neon_bench(s->private, s);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(aic880d80_neon_bench);
+
+void aic880d80_debugfs_register(struct aic880d80_private *priv)
+{
+    if (!aic880d80_debugfs_root)
+        return;
+
+    priv->debugfs_dir = debugfs_create_dir(dev_name(priv->dev),
+                                           aic880d80_debugfs_root);
+    debugfs_create_file("queues", 0400, priv->debugfs_dir, priv,
+                        &aic880d80_queues_fops);
+    debugfs_create_file("rx_filter", 0400, priv->debugfs_dir, priv,
+                        &aic880d80_rx_filter_fops);
+    debugfs_create_file("neon_bench", 0400, priv->debugfs_dir, priv,
+                        &aic880d80_neon_bench_fops);
+}
+
+void aic880d80_debugfs_unregister(struct aic880d80_private *priv)
+{
+    debugfs_remove_recursive(priv->debugfs_dir);
+    priv->debugfs_dir = NULL;
+}
+
+void aic880d80_debugfs_init(void)
+{
+    aic880d80_debugfs_root = debugfs_create_dir("aic880d80", NULL);
+}
+
+void aic880d80_debugfs_exit(void)
+{
+    debugfs_remove_recursive(aic880d80_debugfs_root);
+    aic880d80_debugfs_root = NULL;
+}
@@ -0,0 +1,575 @@
+/*
+ * aic880d80_emu.c - Emulated loopback backend for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * With emulate=1 the module registers an "aic880d80-emu" platform device
+ * and drives it with the unmodified ring, NAPI, refill and ethtool code.
+ * The register space is a page of RAM handed to the driver as iobase;
+ * a kthread plays the device against it:
+ *
+ *  - CTRL_RESET zeroes the register file and brings up a 10G link.
+ *  - Each active TX ring is consumed from its HEAD register up to TAIL,
+ *    one SOP..EOP chain at a time and only once the SOP OWN bit is set.
+ *    The frame is copied into the RX slot at RX_HEAD, if RX_TAIL allows,
+ *    and the slots of the chain that carry DESC_INT are written back with
+ *    OWN clear, raising TX_DONE; the others are left as they are.
+ *  - With RX_MPRQ_ENABLE the frame instead goes to the next free strides
+ *    of the buffer at RX_HEAD and is reported in the completion queue,
+ *    with a filler entry closing a buffer the frame does not fit in.
+ *  - RX_DONE / TX_DONE are raised in INT_STATUS and the interrupt handler
+ *    is called while INT_STATUS & INT_ENABLE & ~INT_MASK is non-zero,
+ *    so NAPI masking works as on hardware. INT_CLEAR is write-1-to-clear.
+ *  - Every driver register write kicks the thread, which sleeps once it
+ *    has gone a while without finding work.
+ *
+ * Everything the wire would carry is looped back, there is no address
+ * filtering, no segmentation and no launch-time hold. Buffers are reached
+ * through dma-direct (no IOMMU), so DMA addresses are physical.
+ */
+#include "aic880d80.h"
+#include <linux/platform_device.h>
+#include <linux/dma-direct.h>
+#include <linux/etherdevice.h>
+#include <linux/kthread.h>
+#include <linux/pm_runtime.h>
+#include <linux/wait.h>
+#include <linux/bitfield.h>
+
+#define AIC880D80_EMU_NAME          "aic880d80-emu"
+#define AIC880D80_EMU_REGS_SIZE     SZ_4K
+#define AIC880D80_EMU_TX_BUDGET     64      /* Frames per ring per pass */
+#define AIC880D80_EMU_SPIN          1000    /* Idle passes before sleeping */
+
+/* Ring 0 answers at both the legacy TX registers and TXQ(0) */
+static const u32 aic880d80_emu_legacy[][2] = {
+    { AIC880D80_REG_TX_DESC_LO, AIC880D80_TXQ_DESC_LO },
+    { AIC880D80_REG_TX_DESC_HI, AIC880D80_TXQ_DESC_HI },
+    { AIC880D80_REG_TX_DESC_LEN, AIC880D80_TXQ_DESC_LEN },
+    { AIC880D80_REG_TX_TAIL, AIC880D80_TXQ_TAIL },
+    { AIC880D80_REG_TX_HEAD, AIC880D80_TXQ_HEAD },
+};
+
+struct aic880d80_emu {
+    struct device *dev;
+    void __iomem *iobase;       /* RAM posing as the register space */
+    struct task_struct *thread;
+    wait_queue_head_t wq;       /* Idle engine waits here for a kick */
+    bool kicked;                /* Register written since the last pass */
+    struct aic880d80_private *priv;     /* Set once probe is through */
+    u32 legacy[ARRAY_SIZE(aic880d80_emu_legacy)];
+    u8 mac[ETH_ALEN];
+    /* Striding RX, reset with the device */
+    u32 cq_tail;
+    u32 cq_phase;
+    u32 mprq_stride;    /* Strides used in the buffer at RX_HEAD */
+};
+
+static struct platform_device *aic880d80_emu_pdev;
+
+static u32 aic880d80_emu_rd(struct aic880d80_emu *emu, u32 reg)
+{
+    return readl_relaxed(emu->iobase + reg);
+}
+
+static void aic880d80_emu_wr(struct aic880d80_emu *emu, u32 reg, u32 val)
+{
+    writel_relaxed(val, emu->iobase + reg);
+}
+
+static void aic880d80_emu_raise(struct aic880d80_emu *emu, u32 bits)
+{
+    aic880d80_emu_wr(emu, AIC880D80_REG_INT_STATUS,
+                     aic880d80_emu_rd(emu, AIC880D80_REG_INT_STATUS) | bits);
+}
+
+static void *aic880d80_emu_va(struct aic880d80_emu *emu, u32 lo, u32 hi)
+{
+    dma_addr_t dma = ((u64)hi << 32) | lo;
+
+    return phys_to_virt(dma_to_phys(emu->dev, dma));
+}
+
+static bool aic880d80_emu_enabled(struct aic880d80_emu *emu, u32 ctrl_bit,
+                                  u32 dma_bit)
+{
+    u32 ctrl = aic880d80_emu_rd(emu, AIC880D80_REG_CTRL);
+
+    return (ctrl & AIC880D80_CTRL_ENABLE) && (ctrl & ctrl_bit) &&
+           (aic880d80_emu_rd(emu, AIC880D80_REG_DMA_CTRL) & dma_bit);
+}
+
+/* CTRL is cleared last: the driver polls it and programs right after */
+static bool aic880d80_emu_reset(struct aic880d80_emu *emu)
+{
+    int i;
+
+    if (!(aic880d80_emu_rd(emu, AIC880D80_REG_CTRL) & AIC880D80_CTRL_RESET))
+        return false;
+
+    for (i = 0; i < AIC880D80_EMU_REGS_SIZE; i += sizeof(u32))
+        if (i != AIC880D80_REG_CTRL)
+            aic880d80_emu_wr(emu, i, 0);
+    memset(emu->legacy, 0, sizeof(emu->legacy));
+    emu->cq_tail = 0;
+    emu->cq_phase = 1;
+    emu->mprq_stride = 0;
+
+    aic880d80_emu_wr(emu, AIC880D80_REG_DEVICE_ID, AIC880D80_DEVICE_ID);
+    aic880d80_emu_wr(emu, AIC880D80_REG_STATUS,
+                     AIC880D80_STATUS_LINK_UP | AIC880D80_STATUS_FULL_DUP |
+                     AIC880D80_STATUS_SPEED_10G);
+    aic880d80_emu_wr(emu, AIC880D80_REG_MAC_ADDR_LO,
+                     emu->mac[0] | (emu->mac[1] << 8) |
+                     (emu->mac[2] << 16) | (emu->mac[3] << 24));
+    aic880d80_emu_wr(emu, AIC880D80_REG_MAC_ADDR_HI,
+                     emu->mac[4] | (emu->mac[5] << 8));
+
+    smp_wmb();
+    aic880d80_emu_wr(emu, AIC880D80_REG_CTRL, 0);
+    return true;
+}
+
+/* Pick up driver writes to the legacy ring 0 registers */
+static void aic880d80_emu_sync_legacy(struct aic880d80_emu *emu)
+{
+    u32 i, val;
+
+    for (i = 0; i < ARRAY_SIZE(aic880d80_emu_legacy); i++) {
+        val = aic880d80_emu_rd(emu, aic880d80_emu_legacy[i][0]);
+        if (val == emu->legacy[i])
+            continue;
+        aic880d80_emu_wr(emu, AIC880D80_REG_TXQ(0, aic880d80_emu_legacy[i][1]),
+                         val);
+        emu->legacy[i] = val;
+    }
+}
+
+/*
+ * The posted RX descriptor at RX_HEAD, or NULL if there is none: the
+ * device never fetches at or past RX_TAIL.
+ */
+static struct aic880d80_desc *aic880d80_emu_rx_desc(struct aic880d80_emu *emu)
+{
+    u32 size = aic880d80_emu_rd(emu, AIC880D80_REG_RX_DESC_LEN);
+    u32 head = aic880d80_emu_rd(emu, AIC880D80_REG_RX_HEAD);
+    struct aic880d80_desc *desc;
+
+    if (!size || head >= size ||
+        head == aic880d80_emu_rd(emu, AIC880D80_REG_RX_TAIL) ||
+        !aic880d80_emu_enabled(emu, AIC880D80_CTRL_RX_ENABLE,
+                               AIC880D80_DMA_RX_ENABLE))
+        return NULL;
+
+    desc = aic880d80_emu_va(emu, aic880d80_emu_rd(emu, AIC880D80_REG_RX_DESC_LO),
+                            aic880d80_emu_rd(emu, AIC880D80_REG_RX_DESC_HI));
+    desc += head;
+    smp_rmb();
+    if (!(le32_to_cpu(READ_ONCE(desc->status)) & AIC880D80_DESC_OWN))
+        return NULL;
+    return desc;
+}
+
+static u8 *aic880d80_emu_rx_buf(struct aic880d80_emu *emu,
+                                const struct aic880d80_desc *desc)
+{
+    return aic880d80_emu_va(emu, lower_32_bits(le64_to_cpu(desc->buffer_addr)),
+                            upper_32_bits(le64_to_cpu(desc->buffer_addr)));
+}
+
+static void aic880d80_emu_rx_next(struct aic880d80_emu *emu)
+{
+    u32 size = aic880d80_emu_rd(emu, AIC880D80_REG_RX_DESC_LEN);
+    u32 head = aic880d80_emu_rd(emu, AIC880D80_REG_RX_HEAD);
+
+    aic880d80_emu_wr(emu, AIC880D80_REG_RX_HEAD, head + 1 == size ? 0 : head + 1);
+}
+
+static bool aic880d80_emu_mprq(struct aic880d80_emu *emu)
+{
+    return (aic880d80_emu_rd(emu, AIC880D80_REG_RX_MPRQ) & AIC880D80_RX_MPRQ_ENABLE) &&
+           aic880d80_emu_rd(emu, AIC880D80_REG_RX_CQ_LEN);
+}
+
+static u32 aic880d80_emu_stride_size(struct aic880d80_emu *emu)
+{
+    return 1U << FIELD_GET(AIC880D80_RX_MPRQ_STRIDE_SHIFT,
+                           aic880d80_emu_rd(emu, AIC880D80_REG_RX_MPRQ));
+}
+
+static u32 aic880d80_emu_strides(struct aic880d80_emu *emu)
+{
+    return FIELD_GET(AIC880D80_RX_MPRQ_STRIDES,
+                     aic880d80_emu_rd(emu, AIC880D80_REG_RX_MPRQ));
+}
+
+/* Free completion entries; the one before RX_CQ_HEAD is never written */
+static u32 aic880d80_emu_cq_free(struct aic880d80_emu *emu)
+{
+    u32 size = aic880d80_emu_rd(emu, AIC880D80_REG_RX_CQ_LEN);
+    u32 head = aic880d80_emu_rd(emu, AIC880D80_REG_RX_CQ_HEAD);
+
+    return (head + size - emu->cq_tail - 1) % size;
+}
+
+/* Post one completion entry; a BUF_DONE entry also moves RX_HEAD on */
+static void aic880d80_emu_cqe(struct aic880d80_emu *emu, u32 len, u32 stride,
+                              u32 strides, u32 flags)
+{
+    struct aic880d80_rx_cqe *cqe;
+
+    cqe = aic880d80_emu_va(emu, aic880d80_emu_rd(emu, AIC880D80_REG_RX_CQ_LO),
+                           aic880d80_emu_rd(emu, AIC880D80_REG_RX_CQ_HI));
+    cqe += emu->cq_tail;
+    cqe->length = cpu_to_le16(len);
+    cqe->stride = cpu_to_le16(stride);
+    cqe->strides = cpu_to_le16(strides);
+    /* Frame and entry before the phase bit */
+    smp_wmb();
+    WRITE_ONCE(cqe->status,
+               cpu_to_le32(flags | (emu->cq_phase ? AIC880D80_CQE_PHASE : 0)));
+
+    if (++emu->cq_tail == aic880d80_emu_rd(emu, AIC880D80_REG_RX_CQ_LEN)) {
+        emu->cq_tail = 0;
+        emu->cq_phase ^= 1;
+    }
+    aic880d80_emu_wr(emu, AIC880D80_REG_RX_CQ_TAIL, emu->cq_tail);
+
+    if (flags & AIC880D80_CQE_BUF_DONE) {
+        aic880d80_emu_rx_next(emu);
+        emu->mprq_stride = 0;
+    }
+    aic880d80_emu_raise(emu, AIC880D80_INT_RX_DONE);
+}
+
+/* Striding RX: the strides a frame of len bytes lands in, or NULL */
+static u8 *aic880d80_emu_mprq_slot(struct aic880d80_emu *emu, u32 len)
+{
+    u32 stride_size = aic880d80_emu_stride_size(emu);
+    u32 strides = aic880d80_emu_strides(emu);
+    u32 need = DIV_ROUND_UP(len, stride_size);
+    struct aic880d80_desc *desc;
+
+    /* Room for a filler and the frame itself */
+    if (need > strides || aic880d80_emu_cq_free(emu) < 2)
+        return NULL;
+
+    desc = aic880d80_emu_rx_desc(emu);
+    if (desc && emu->mprq_stride + need > strides) {
+        aic880d80_emu_cqe(emu, 0, emu->mprq_stride,
+                          strides - emu->mprq_stride, AIC880D80_CQE_BUF_DONE);
+        desc = aic880d80_emu_rx_desc(emu);
+    }
+    if (!desc)
+        return NULL;
+    return aic880d80_emu_rx_buf(emu, desc) + emu->mprq_stride * stride_size;
+}
+
+/* Where a frame of len bytes lands, or NULL to drop it */
+static u8 *aic880d80_emu_rx_slot(struct aic880d80_emu *emu, u32 len)
+{
+    struct aic880d80_desc *desc;
+
+    if (aic880d80_emu_mprq(emu))
+        return aic880d80_emu_mprq_slot(emu, len);
+
+    desc = aic880d80_emu_rx_desc(emu);
+    if (!desc || AIC880D80_DESC_GET_LEN(desc) < len)
+        return NULL;
+    return aic880d80_emu_rx_buf(emu, desc);
+}
+
+/* Report the frame just copied to the slot from aic880d80_emu_rx_slot() */
+static void aic880d80_emu_rx_done(struct aic880d80_emu *emu, u32 len)
+{
+    struct aic880d80_desc *desc;
+    u32 need, stride;
+
+    if (aic880d80_emu_mprq(emu)) {
+        need = DIV_ROUND_UP(len, aic880d80_emu_stride_size(emu));
+        stride = emu->mprq_stride;
+        emu->mprq_stride += need;
+        aic880d80_emu_cqe(emu, len, stride, need,
+                          emu->mprq_stride == aic880d80_emu_strides(emu) ?
+                          AIC880D80_CQE_BUF_DONE : 0);
+        return;
+    }
+
+    /* Gone if the driver retracted RX_TAIL meanwhile */
+    desc = aic880d80_emu_rx_desc(emu);
+    if (!desc)
+        return;
+    AIC880D80_DESC_SET_LEN(desc, len);
+    /* Frame and length before OWN goes back */
+    smp_wmb();
+    WRITE_ONCE(desc->status,
+               cpu_to_le32(AIC880D80_DESC_SOP | AIC880D80_DESC_EOP));
+    aic880d80_emu_rx_next(emu);
+    aic880d80_emu_raise(emu, AIC880D80_INT_RX_DONE);
+}
+
+/* Loop up to AIC880D80_EMU_TX_BUDGET frames of one TX ring; returns frames */
+static int aic880d80_emu_tx_ring(struct aic880d80_emu *emu, u32 q)
+{
+    u32 size = aic880d80_emu_rd(emu, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_DESC_LEN));
+    u32 head = aic880d80_emu_rd(emu, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_HEAD));
+    u32 tail = aic880d80_emu_rd(emu, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_TAIL));
+    struct aic880d80_desc *ring;
+    bool reported = false;
+    int frames = 0;
+
+    if (!size || head >= size || tail >= size)
+        return 0;
+
+    ring = aic880d80_emu_va(emu,
+                            aic880d80_emu_rd(emu, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_DESC_LO)),
+                            aic880d80_emu_rd(emu, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_DESC_HI)));
+
+    while (head != tail && frames < AIC880D80_EMU_TX_BUDGET) {
+        u32 i = head, end, len = 0, status;
+        u8 *buf, *dst;
+
+        /* Walk SOP..EOP; the SOP OWN bit publishes the whole chain */
+        do {
+            status = le32_to_cpu(READ_ONCE(ring[i].status));
+            if (!(status & AIC880D80_DESC_OWN))
+                goto out;
+            smp_rmb();
+            len += AIC880D80_DESC_GET_LEN(&ring[i]);
+            i = i + 1 == size ? 0 : i + 1;
+        } while (!(status & AIC880D80_DESC_EOP) && i != tail);
+        if (!(status & AIC880D80_DESC_EOP))
+            goto out;
+        end = i;
+
+        buf = aic880d80_emu_rx_slot(emu, len);
+        dst = buf;
+
+        for (i = head; i != end; i = i + 1 == size ? 0 : i + 1) {
+            u32 seg = AIC880D80_DESC_GET_LEN(&ring[i]);
+
+            if (dst) {
+                memcpy(dst, aic880d80_emu_va(emu,
+                                             lower_32_bits(le64_to_cpu(ring[i].buffer_addr)),
+                                             upper_32_bits(le64_to_cpu(ring[i].buffer_addr))),
+                       seg);
+                dst += seg;
+            }
+        }
+        if (buf)
+            aic880d80_emu_rx_done(emu, len);
+
+        /* Done reading the buffers before the driver may free them */
+        smp_mb();
+        for (i = head; i != end; i = i + 1 == size ? 0 : i + 1) {
+            status = le32_to_cpu(ring[i].status);
+            if (!(status & AIC880D80_DESC_INT))
+                continue;
+            WRITE_ONCE(ring[i].status, cpu_to_le32(status & ~AIC880D80_DESC_OWN));
+            reported = true;
+        }
+        head = end;
+        frames++;
+    }
+out:
+    if (frames)
+        aic880d80_emu_wr(emu, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_HEAD), head);
+    if (reported)
+        aic880d80_emu_raise(emu, AIC880D80_INT_TX_DONE);
+    return frames;
+}
+
+static bool aic880d80_emu_tx(struct aic880d80_emu *emu)
+{
+    u32 sched = aic880d80_emu_rd(emu, AIC880D80_REG_TX_SCHED);
+    u32 rings = ((sched & AIC880D80_TX_SCHED_RINGS_MASK) >>
+                 AIC880D80_TX_SCHED_RINGS_SHIFT) + 1;
+    int frames = 0;
+    u32 q;
+
+    if (!aic880d80_emu_enabled(emu, AIC880D80_CTRL_TX_ENABLE,
+                               AIC880D80_DMA_TX_ENABLE))
+        return false;
+
+    /* Highest ring first, like strict priority */
+    for (q = rings; q-- > 0; )
+        frames += aic880d80_emu_tx_ring(emu, q);
+
+    /* The device owns HEAD; mirror ring 0 into its legacy alias */
+    emu->legacy[4] = aic880d80_emu_rd(emu, AIC880D80_REG_TXQ(0, AIC880D80_TXQ_HEAD));
+    aic880d80_emu_wr(emu, AIC880D80_REG_TX_HEAD, emu->legacy[4]);
+    return frames;
+}
+
+/* Level-triggered: keep calling the handler while anything is pending */
+static void aic880d80_emu_irq(struct aic880d80_emu *emu)
+{
+    struct aic880d80_private *priv = READ_ONCE(emu->priv);
+    u32 pending, clear;
+
+    if (!priv || !(aic880d80_emu_rd(emu, AIC880D80_REG_CTRL) &
+                   AIC880D80_CTRL_INT_ENABLE))
+        return;
+
+    pending = aic880d80_emu_rd(emu, AIC880D80_REG_INT_STATUS) &
+              aic880d80_emu_rd(emu, AIC880D80_REG_INT_ENABLE) &
+              ~aic880d80_emu_rd(emu, AIC880D80_REG_INT_MASK);
+    if (!pending)
+        return;
+
+    /* Hard-IRQ-like context; NAPI's softirq runs on local_bh_enable() */
+    local_bh_disable();
+    local_irq_disable();
+    aic880d80_interrupt(0, priv);
+    local_irq_enable();
+    local_bh_enable();
+
+    clear = aic880d80_emu_rd(emu, AIC880D80_REG_INT_CLEAR);
+    aic880d80_emu_wr(emu, AIC880D80_REG_INT_CLEAR, 0);
+    aic880d80_emu_wr(emu, AIC880D80_REG_INT_STATUS,
+                     aic880d80_emu_rd(emu, AIC880D80_REG_INT_STATUS) & ~clear);
+}
+
+void aic880d80_emu_kick(struct aic880d80_emu *emu)
+{
+    WRITE_ONCE(emu->kicked, true);
+    if (wq_has_sleeper(&emu->wq))
+        wake_up(&emu->wq);
+}
+
+/*
+ * Work only ever arrives through a register write, so once a run of
+ * passes finds nothing to do the engine sleeps until the next one.
+ */
+static int aic880d80_emu_thread(void *data)
+{
+    struct aic880d80_emu *emu = data;
+    unsigned int idle = 0;
+    bool busy;
+
+    while (!kthread_should_stop()) {
+        if (kthread_should_park())
+            kthread_parkme();
+
+        /* A write landing during the pass is seen by the next one */
+        WRITE_ONCE(emu->kicked, false);
+        smp_mb();
+
+        busy = aic880d80_emu_reset(emu);
+        aic880d80_emu_sync_legacy(emu);
+        busy |= aic880d80_emu_tx(emu);
+        aic880d80_emu_irq(emu);
+
+        if (busy || ++idle < AIC880D80_EMU_SPIN) {
+            if (busy)
+                idle = 0;
+            cond_resched();
+        } else {
+            wait_event_idle(emu->wq, READ_ONCE(emu->kicked) ||
+                                     kthread_should_stop() ||
+                                     kthread_should_park());
+            idle = 0;
+        }
+    }
+    return 0;
+}
+
+static int aic880d80_emu_probe(struct platform_device *pdev)
+{
+    struct device *dev = &pdev->dev;
+    struct aic880d80_emu *emu;
+    void *regs;
+    int ret;
+
+    emu = devm_kzalloc(dev, sizeof(*emu), GFP_KERNEL);
+    regs = devm_kzalloc(dev, AIC880D80_EMU_REGS_SIZE, GFP_KERNEL);
+    if (!emu || !regs)
+        return -ENOMEM;
+    emu->dev = dev;
+    emu->iobase = (void __iomem __force *)regs;
+    init_waitqueue_head(&emu->wq);
+    eth_random_addr(emu->mac);
+
+    /* The "device" is a CPU: cache coherent and 64-bit capable */
+    ret = dma_coerce_mask_and_coherent(dev, DMA_BIT_MASK(64));
+    if (ret)
+        return ret;
+#if defined(CONFIG_ARCH_HAS_SYNC_DMA_FOR_DEVICE) || \
+    defined(CONFIG_ARCH_HAS_SYNC_DMA_FOR_CPU) || \
+    defined(CONFIG_ARCH_HAS_SYNC_DMA_FOR_CPU_ALL)
+    dev->dma_coherent = true;
+#endif
+
+    /* Powered, with runtime PM on as the PCI core leaves a device */
+    pm_runtime_set_active(dev);
+    ret = devm_pm_runtime_enable(dev);
+    if (ret)
+        return ret;
+
+    emu->thread = kthread_run(aic880d80_emu_thread, emu, AIC880D80_EMU_NAME);
+    if (IS_ERR(emu->thread))
+        return PTR_ERR(emu->thread);
+
+    ret = aic880d80_probe_common(dev, NULL, emu->iobase, emu);
+    if (ret) {
+        kthread_stop(emu->thread);
+        return ret;
+    }
+
+    WRITE_ONCE(emu->priv, netdev_priv(dev_get_drvdata(dev)));
+    return 0;
+}
+
+static void aic880d80_emu_remove(struct platform_device *pdev)
+{
+    struct aic880d80_private *priv = netdev_priv(platform_get_drvdata(pdev));
+    struct aic880d80_emu *emu = priv->emu;
+
+    /*
+     * The engine must keep answering resets while the interface closes,
+     * but must not call into the driver once NAPI is gone. Parking waits
+     * for a pass still inside the interrupt handler to return.
+     */
+    WRITE_ONCE(emu->priv, NULL);
+    kthread_park(emu->thread);
+    kthread_unpark(emu->thread);
+
+    aic880d80_remove_common(&pdev->dev);
+    kthread_stop(emu->thread);
+}
+
+static struct platform_driver aic880d80_emu_driver = {
+    .driver.name = AIC880D80_EMU_NAME,
+    .driver.pm = pm_ptr(&aic880d80_pm_ops),
+    .probe = aic880d80_emu_probe,
+    .remove = aic880d80_emu_remove,
+};
+
+int aic880d80_emu_register(void)
+{
+    int ret;
+
+    ret = platform_driver_register(&aic880d80_emu_driver);
+    if (ret)
+        return ret;
+
+    aic880d80_emu_pdev = platform_device_register_simple(AIC880D80_EMU_NAME,
+                                                         PLATFORM_DEVID_NONE,
+                                                         NULL, 0);
+    if (IS_ERR(aic880d80_emu_pdev)) {
+        platform_driver_unregister(&aic880d80_emu_driver);
+        return PTR_ERR(aic880d80_emu_pdev);
+    }
+    return 0;
+}
+
+void aic880d80_emu_unregister(void)
+{
+    platform_device_unregister(aic880d80_emu_pdev);
+    platform_driver_unregister(&aic880d80_emu_driver);
+}
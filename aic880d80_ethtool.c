@@ -8,7 +8,7 @@ static void aic880d80_get_drvinfo(struct net_device *netdev, struct ethtool_drvi
 {
     strlcpy(info->driver, "aic880d80", sizeof(info->driver));
     strlcpy(info->version, "1.0.0", sizeof(info->version));
-    strlcpy(info->bus_info, pci_name(to_pci_dev(netdev->dev.parent)), sizeof(info->bus_info));
+    strlcpy(info->bus_info, dev_name(netdev->dev.parent), sizeof(info->bus_info));
 }
 
 static int aic880d80_get_link(struct net_device *netdev)
@@ -19,18 +19,290 @@ static int aic880d80_get_link(struct net_device *netdev)
 static int aic880d80_get_ringparam(struct net_device *netdev, struct ethtool_ringparam *ring)
 {
     struct aic880d80_private *priv = netdev_priv(netdev);
-    ring->rx_max_pending = AIC880D80_RX_RING_SIZE;
-    ring->tx_max_pending = AIC880D80_TX_RING_SIZE;
-    ring->rx_pending = priv->rx_ring ? AIC880D80_RX_RING_SIZE : 0;
-    ring->tx_pending = priv->tx_ring ? AIC880D80_TX_RING_SIZE : 0;
+    ring->rx_max_pending = AIC880D80_MAX_RING_SIZE;
+    ring->tx_max_pending = AIC880D80_MAX_RING_SIZE;
+    ring->rx_pending = priv->rx_ring ? priv->rx_ring->size : 0;
+    ring->tx_pending = priv->tx_ring[0] ? priv->tx_ring[0]->size : 0;
+    return 0;
+}
+
+struct aic880d80_ethtool_stat {
+    char name[ETH_GSTRING_LEN];
+    size_t offset;
+};
+
+#define AIC880D80_PRIV_STAT(_name, _field) { \
+    .name = _name, \
+    .offset = offsetof(struct aic880d80_private, _field), \
+}
+
+static const struct aic880d80_ethtool_stat aic880d80_gstrings_stats[] = {
+    AIC880D80_PRIV_STAT("tx_timeouts", tx_timeouts),
+    AIC880D80_PRIV_STAT("tx_queue_resets", tx_queue_resets),
+    AIC880D80_PRIV_STAT("tx_reset_failures", tx_reset_failures),
+    AIC880D80_PRIV_STAT("tx_recovery_last_ns", tx_recovery_last_ns),
+    AIC880D80_PRIV_STAT("tx_recovery_max_ns", tx_recovery_max_ns),
+    AIC880D80_PRIV_STAT("tx_recovery_total_ns", tx_recovery_total_ns),
+    AIC880D80_PRIV_STAT("hw_stats_torn", hw_stats_torn),
+    AIC880D80_PRIV_STAT("rx_copybreak", rx_copybreak_pkts),
+    AIC880D80_PRIV_STAT("tx_sw_csum", tx_sw_csum),
+    AIC880D80_PRIV_STAT("rx_shrinks", rx_shrinks),
+    AIC880D80_PRIV_STAT("rx_bufs_released", rx_bufs_released),
+    AIC880D80_PRIV_STAT("rx_regrows", rx_regrows),
+    AIC880D80_PRIV_STAT("rx_filter_writes", rx_filter_writes),
+    AIC880D80_PRIV_STAT("fwd_rx_steered", fwd_rx_steered),
+    AIC880D80_PRIV_STAT("pm_suspends", pm_suspends),
+    AIC880D80_PRIV_STAT("pm_resume_ns", pm_resume_ns),
+    AIC880D80_PRIV_STAT("pm_first_rx_ns", pm_first_rx_ns),
+    AIC880D80_PRIV_STAT("pm_first_rx_max_ns", pm_first_rx_max_ns),
+    AIC880D80_PRIV_STAT("pool_chunk_maps", pool_chunk_maps),
+    AIC880D80_PRIV_STAT("rx_dma_maps", rx_dma_maps),
+    AIC880D80_PRIV_STAT("rx_dma_unmaps", rx_dma_unmaps),
+    AIC880D80_PRIV_STAT("rx_mprq_recycled", rx_mprq_recycled),
+    AIC880D80_PRIV_STAT("rx_mprq_pinned", rx_mprq_pinned),
+    AIC880D80_PRIV_STAT("rx_mprq_fillers", rx_mprq_fillers),
+};
+
+#define AIC880D80_HW_STAT(_name, _field) { \
+    .name = _name, \
+    .offset = offsetof(struct aic880d80_stats, _field), \
+}
+
+/* MAC/PHY counters, served from the device-written snapshot */
+static const struct aic880d80_ethtool_stat aic880d80_gstrings_hw_stats[] = {
+    AIC880D80_HW_STAT("rx_crc_errors", rx_crc_errors),
+    AIC880D80_HW_STAT("rx_length_errors", rx_length_errors),
+    AIC880D80_HW_STAT("rx_fifo_errors", rx_fifo_errors),
+    AIC880D80_HW_STAT("tx_fifo_errors", tx_fifo_errors),
+    AIC880D80_HW_STAT("rx_missed_errors", rx_missed_errors),
+    AIC880D80_HW_STAT("tx_aborted_errors", tx_aborted_errors),
+    AIC880D80_HW_STAT("tx_carrier_errors", tx_carrier_errors),
+    AIC880D80_HW_STAT("tx_window_errors", tx_window_errors),
+};
+
+#define AIC880D80_TC_STAT(_name, _field) { \
+    .name = _name, \
+    .offset = offsetof(struct aic880d80_tc_stats, _field), \
+}
+
+/* Per traffic class (= TX ring) counters, reported for every ring */
+static const struct aic880d80_ethtool_stat aic880d80_gstrings_tc_stats[] = {
+    AIC880D80_TC_STAT("packets", packets),
+    AIC880D80_TC_STAT("bytes", bytes),
+    AIC880D80_TC_STAT("dropped", dropped),
+    AIC880D80_TC_STAT("stops", stops),
+    AIC880D80_TC_STAT("uso_packets", uso_packets),
+    AIC880D80_TC_STAT("uso_segs", uso_segs),
+    AIC880D80_TC_STAT("pushes", pushes),
+    AIC880D80_TC_STAT("reports", reports),
+    AIC880D80_TC_STAT("dma_maps", dma_maps),
+    AIC880D80_TC_STAT("dma_unmaps", dma_unmaps),
+    AIC880D80_TC_STAT("pool_copies", pool_copies),
+};
+
+#define AIC880D80_PRIV_STATS_LEN ARRAY_SIZE(aic880d80_gstrings_stats)
+#define AIC880D80_HW_STATS_LEN ARRAY_SIZE(aic880d80_gstrings_hw_stats)
+#define AIC880D80_TC_STATS_LEN \
+    (ARRAY_SIZE(aic880d80_gstrings_tc_stats) * AIC880D80_MAX_TX_QUEUES)
+#define AIC880D80_STATS_LEN (AIC880D80_PRIV_STATS_LEN + AIC880D80_HW_STATS_LEN + \
+                             AIC880D80_TC_STATS_LEN)
+
+/* Offline loopback latency, mean ns per minimum-size frame */
+static const char aic880d80_gstrings_test[][ETH_GSTRING_LEN] = {
+    "Doorbell latency ns (offline)",
+    "Push latency ns     (offline)",
+    "Push saves ns       (offline)",
+    "Reopen              (offline)",
+};
+
+#define AIC880D80_TEST_LEN ARRAY_SIZE(aic880d80_gstrings_test)
+
+static const char aic880d80_gstrings_priv_flags[][ETH_GSTRING_LEN] = {
+    "tx-push",
+};
+
+static int aic880d80_get_sset_count(struct net_device *netdev, int sset)
+{
+    switch (sset) {
+    case ETH_SS_STATS:
+        return AIC880D80_STATS_LEN;
+    case ETH_SS_TEST:
+        return AIC880D80_TEST_LEN;
+    case ETH_SS_PRIV_FLAGS:
+        return ARRAY_SIZE(aic880d80_gstrings_priv_flags);
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+static void aic880d80_get_strings(struct net_device *netdev, u32 sset, u8 *data)
+{
+    int i, q;
+
+    switch (sset) {
+    case ETH_SS_TEST:
+        memcpy(data, aic880d80_gstrings_test, sizeof(aic880d80_gstrings_test));
+        return;
+    case ETH_SS_PRIV_FLAGS:
+        memcpy(data, aic880d80_gstrings_priv_flags,
+               sizeof(aic880d80_gstrings_priv_flags));
+        return;
+    case ETH_SS_STATS:
+        break;
+    default:
+        return;
+    }
+
+    for (i = 0; i < AIC880D80_PRIV_STATS_LEN; i++) {
+        memcpy(data, aic880d80_gstrings_stats[i].name, ETH_GSTRING_LEN);
+        data += ETH_GSTRING_LEN;
+    }
+    for (i = 0; i < AIC880D80_HW_STATS_LEN; i++) {
+        memcpy(data, aic880d80_gstrings_hw_stats[i].name, ETH_GSTRING_LEN);
+        data += ETH_GSTRING_LEN;
+    }
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++)
+        for (i = 0; i < ARRAY_SIZE(aic880d80_gstrings_tc_stats); i++)
+            ethtool_sprintf(&data, "tc%d_tx_%s", q,
+                            aic880d80_gstrings_tc_stats[i].name);
+}
+
+/* Folded totals plus the live ring, if the interface is up */
+static void aic880d80_get_tc_stats(struct aic880d80_private *priv, u32 q,
+                                   struct aic880d80_tc_stats *tc)
+{
+    struct aic880d80_ring *tx = priv->tx_ring[q];
+
+    *tc = priv->tc_stats[q];
+    if (!tx)
+        return;
+    tc->packets += READ_ONCE(tx->packets);
+    tc->bytes += READ_ONCE(tx->bytes);
+    tc->dropped += READ_ONCE(tx->dropped);
+    tc->stops += READ_ONCE(tx->stops);
+    tc->uso_packets += READ_ONCE(tx->uso_packets);
+    tc->uso_segs += READ_ONCE(tx->uso_segs);
+    tc->pushes += READ_ONCE(tx->pushes);
+    tc->reports += READ_ONCE(tx->reports);
+    tc->dma_maps += READ_ONCE(tx->dma_maps);
+    tc->dma_unmaps += READ_ONCE(tx->dma_unmaps);
+    tc->pool_copies += READ_ONCE(tx->pool_copies);
+}
+
+static void aic880d80_get_ethtool_stats(struct net_device *netdev,
+                                        struct ethtool_stats *stats, u64 *data)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    struct aic880d80_stats hw = {};
+    struct aic880d80_tc_stats tc;
+    int i, q;
+
+    for (i = 0; i < AIC880D80_PRIV_STATS_LEN; i++)
+        *data++ = *(u64 *)((char *)priv + aic880d80_gstrings_stats[i].offset);
+
+    aic880d80_read_hw_stats(priv, &hw);
+    for (i = 0; i < AIC880D80_HW_STATS_LEN; i++)
+        *data++ = *(u64 *)((char *)&hw + aic880d80_gstrings_hw_stats[i].offset);
+
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++) {
+        aic880d80_get_tc_stats(priv, q, &tc);
+        for (i = 0; i < ARRAY_SIZE(aic880d80_gstrings_tc_stats); i++)
+            *data++ = *(u64 *)((char *)&tc + aic880d80_gstrings_tc_stats[i].offset);
+    }
+}
+
+/*
+ * The loopback measurement takes the device over, so a running interface
+ * is brought down for the duration and up again afterwards, through the
+ * core so notifiers and the operstate follow. A failed reopen leaves the
+ * interface down and is reported in the last result.
+ */
+static void aic880d80_self_test(struct net_device *netdev,
+                                struct ethtool_test *eth_test, u64 *data)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    bool running = netif_running(netdev);
+
+    memset(data, 0, AIC880D80_TEST_LEN * sizeof(*data));
+    if (!(eth_test->flags & ETH_TEST_FL_OFFLINE))
+        return;
+
+    if (running)
+        dev_close(netdev);
+
+    if (aic880d80_loopback_latency(priv, &data[0], &data[1]))
+        eth_test->flags |= ETH_TEST_FL_FAILED;
+    else if (data[1] && data[1] < data[0])
+        data[2] = data[0] - data[1];
+
+    if (running && dev_open(netdev, NULL)) {
+        netdev_err(netdev, "Failed to reopen after self-test\n");
+        data[3] = 1;
+        eth_test->flags |= ETH_TEST_FL_FAILED;
+    }
+}
+
+/* tx-frames: descriptors between requested TX completions (DESC_INT) */
+static int aic880d80_get_coalesce(struct net_device *netdev,
+                                  struct ethtool_coalesce *ec,
+                                  struct kernel_ethtool_coalesce *kec,
+                                  struct netlink_ext_ack *extack)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+
+    ec->tx_max_coalesced_frames = priv->tx_int_desc;
+    return 0;
+}
+
+static int aic880d80_set_coalesce(struct net_device *netdev,
+                                  struct ethtool_coalesce *ec,
+                                  struct kernel_ethtool_coalesce *kec,
+                                  struct netlink_ext_ack *extack)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+
+    if (!ec->tx_max_coalesced_frames ||
+        ec->tx_max_coalesced_frames > AIC880D80_TX_INT_DESC_MAX) {
+        NL_SET_ERR_MSG_FMT_MOD(extack, "tx-frames must be 1-%u",
+                               AIC880D80_TX_INT_DESC_MAX);
+        return -EINVAL;
+    }
+
+    WRITE_ONCE(priv->tx_int_desc, ec->tx_max_coalesced_frames);
+    return 0;
+}
+
+static u32 aic880d80_get_priv_flags(struct net_device *netdev)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+
+    return priv->priv_flags;
+}
+
+static int aic880d80_set_priv_flags(struct net_device *netdev, u32 flags)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+
+    if ((flags & AIC880D80_PRIV_FLAG_TX_PUSH) && !priv->push_base)
+        return -EOPNOTSUPP;
+
+    WRITE_ONCE(priv->priv_flags, flags);
     return 0;
 }
 
 static const struct ethtool_ops aic880d80_ethtool_ops = {
+    .supported_coalesce_params = ETHTOOL_COALESCE_TX_MAX_FRAMES,
     .get_drvinfo    = aic880d80_get_drvinfo,
     .get_link       = aic880d80_get_link,
     .get_ringparam  = aic880d80_get_ringparam,
-    // .get_strings, .get_ethtool_stats, etc. pueden agregarse después
+    .get_coalesce   = aic880d80_get_coalesce,
+    .set_coalesce   = aic880d80_set_coalesce,
+    .get_sset_count = aic880d80_get_sset_count,
+    .get_strings    = aic880d80_get_strings,
+    .get_ethtool_stats = aic880d80_get_ethtool_stats,
+    .self_test      = aic880d80_self_test,
+    .get_priv_flags = aic880d80_get_priv_flags,
+    .set_priv_flags = aic880d80_set_priv_flags,
 };
 
 void aic880d80_set_ethtool_ops(struct net_device *netdev)
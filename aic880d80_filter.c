@@ -0,0 +1,217 @@
+/*
+ * aic880d80_filter.c - RX address filtering for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "aic880d80.h"
+#include <linux/crc32.h>
+#include <linux/etherdevice.h>
+#include <linux/pm_runtime.h>
+#include <linux/seq_file.h>
+
+/*
+ * Addresses that do not fit the perfect table go to a 64-bin hash per
+ * address type. Past this many the hash passes most of the wire anyway,
+ * so fall back to all-multicast / promiscuous instead.
+ */
+#define AIC880D80_FILTER_HASH_MAX   (AIC880D80_FILTER_HASH_BINS / 2)
+
+static u32 aic880d80_hash_bin(const u8 *addr)
+{
+    return ether_crc(ETH_ALEN, addr) >> 26;
+}
+
+static int aic880d80_find_filter(struct aic880d80_private *priv, const u8 *addr)
+{
+    unsigned int i;
+
+    for_each_set_bit(i, priv->rx_filter_used, AIC880D80_NUM_PERFECT_FILTERS)
+        if (ether_addr_equal(priv->rx_filter_addr[i], addr))
+            return i;
+    return -1;
+}
+
+/* Program perfect entry i with addr, or invalidate it when addr is NULL */
+static void aic880d80_write_filter(struct aic880d80_private *priv,
+                                   unsigned int i, const u8 *addr)
+{
+    if (test_bit(i, priv->rx_filter_used)) {
+        aic880d80_write32_relaxed(priv, AIC880D80_REG_PFILT_HI(i), 0);
+        clear_bit(i, priv->rx_filter_used);
+        priv->rx_filter_writes++;
+    }
+    if (!addr)
+        return;
+
+    aic880d80_write32_relaxed(priv, AIC880D80_REG_PFILT_LO(i),
+                             addr[0] | (addr[1] << 8) | (addr[2] << 16) |
+                             (addr[3] << 24));
+    aic880d80_write32_relaxed(priv, AIC880D80_REG_PFILT_HI(i),
+                             addr[4] | (addr[5] << 8) | AIC880D80_PFILT_VALID);
+    ether_addr_copy(priv->rx_filter_addr[i], addr);
+    set_bit(i, priv->rx_filter_used);
+    priv->rx_filter_writes += 2;
+}
+
+static void aic880d80_write_hash(struct aic880d80_private *priv, u32 reg_lo,
+                                 u64 *shadow, u64 hash)
+{
+    if (*shadow == hash)
+        return;
+
+    aic880d80_write32_relaxed(priv, reg_lo, lower_32_bits(hash));
+    aic880d80_write32_relaxed(priv, reg_lo + 4, upper_32_bits(hash));
+    *shadow = hash;
+    priv->rx_filter_writes += 2;
+}
+
+/*
+ * Place one address: keep the entry it already has, else take a free
+ * perfect entry, else hash it. Returns true if it went to the hash.
+ */
+static bool aic880d80_place_addr(struct aic880d80_private *priv,
+                                 unsigned long *keep, const u8 *addr, u64 *hash)
+{
+    unsigned int i;
+    int slot;
+
+    slot = aic880d80_find_filter(priv, addr);
+    if (slot >= 0 && test_bit(slot, keep))
+        return false;
+
+    i = find_first_zero_bit(keep, AIC880D80_NUM_PERFECT_FILTERS);
+    if (i < AIC880D80_NUM_PERFECT_FILTERS) {
+        aic880d80_write_filter(priv, i, addr);
+        set_bit(i, keep);
+        return false;
+    }
+
+    *hash |= BIT_ULL(aic880d80_hash_bin(addr));
+    return true;
+}
+
+/*
+ * Called under netif_addr_lock_bh with the device powered. The station
+ * address stays in MAC_ADDR; secondary unicast and multicast addresses
+ * share the perfect table, unicast first. Only entries whose address
+ * changed and registers whose value changed are written, so a join or
+ * leave costs a couple of MMIO writes instead of a full table rewrite.
+ */
+static void aic880d80_program_rx_filter(struct net_device *netdev)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    DECLARE_BITMAP(keep, AIC880D80_NUM_PERFECT_FILTERS);
+    u32 filter = AIC880D80_RX_FILTER_BCAST;
+    unsigned int uc_over = 0, mc_over = 0;
+    u64 uc_hash = 0, mc_hash = 0;
+    struct netdev_hw_addr *ha;
+    unsigned int i;
+    int slot;
+
+    /* Entries that already hold a wanted address stay where they are */
+    bitmap_zero(keep, AIC880D80_NUM_PERFECT_FILTERS);
+    netdev_for_each_uc_addr(ha, netdev) {
+        slot = aic880d80_find_filter(priv, ha->addr);
+        if (slot >= 0)
+            set_bit(slot, keep);
+    }
+    netdev_for_each_mc_addr(ha, netdev) {
+        slot = aic880d80_find_filter(priv, ha->addr);
+        if (slot >= 0)
+            set_bit(slot, keep);
+    }
+
+    netdev_for_each_uc_addr(ha, netdev)
+        uc_over += aic880d80_place_addr(priv, keep, ha->addr, &uc_hash);
+    netdev_for_each_mc_addr(ha, netdev)
+        mc_over += aic880d80_place_addr(priv, keep, ha->addr, &mc_hash);
+
+    for_each_set_bit(i, priv->rx_filter_used, AIC880D80_NUM_PERFECT_FILTERS)
+        if (!test_bit(i, keep))
+            aic880d80_write_filter(priv, i, NULL);
+
+    if ((netdev->flags & IFF_PROMISC) || uc_over > AIC880D80_FILTER_HASH_MAX)
+        filter |= AIC880D80_RX_FILTER_PROMISC;
+    else if (uc_over)
+        filter |= AIC880D80_RX_FILTER_UC_HASH;
+
+    if ((netdev->flags & IFF_ALLMULTI) || mc_over > AIC880D80_FILTER_HASH_MAX)
+        filter |= AIC880D80_RX_FILTER_ALLMULTI;
+    else if (mc_over)
+        filter |= AIC880D80_RX_FILTER_MC_HASH;
+
+    /* Hashes before the mode bits that make the device consult them */
+    aic880d80_write_hash(priv, AIC880D80_REG_UC_HASH_LO, &priv->rx_uc_hash,
+                         uc_hash);
+    aic880d80_write_hash(priv, AIC880D80_REG_MC_HASH_LO, &priv->rx_mc_hash,
+                         mc_hash);
+
+    if (filter != priv->rx_filter) {
+        netdev_dbg(netdev, "RX filter %#x -> %#x (%u uc, %u mc in hash)\n",
+                   priv->rx_filter, filter, uc_over, mc_over);
+        aic880d80_write32_relaxed(priv, AIC880D80_REG_RX_FILTER, filter);
+        priv->rx_filter = filter;
+        priv->rx_filter_writes++;
+    }
+}
+
+/*
+ * ndo_set_rx_mode. A runtime-suspended device is not woken from atomic
+ * context; hw_init() programs the current lists when it resumes. -EINVAL
+ * means runtime PM is off and the device is powered.
+ */
+void aic880d80_set_rx_mode(struct net_device *netdev)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    int pm;
+
+    pm = pm_runtime_get_if_active(priv->dev);
+    if (!pm)
+        return;
+
+    aic880d80_program_rx_filter(netdev);
+
+    if (pm > 0)
+        pm_runtime_put(priv->dev);
+}
+
+/*
+ * The filter registers were just reset to zero; forget the shadow and
+ * program the current address lists from scratch.
+ */
+void aic880d80_restore_rx_filter(struct aic880d80_private *priv)
+{
+    struct net_device *netdev = priv->netdev;
+
+    netif_addr_lock_bh(netdev);
+    bitmap_zero(priv->rx_filter_used, AIC880D80_NUM_PERFECT_FILTERS);
+    priv->rx_filter = 0;
+    priv->rx_uc_hash = 0;
+    priv->rx_mc_hash = 0;
+    aic880d80_program_rx_filter(netdev);
+    netif_addr_unlock_bh(netdev);
+}
+
+void aic880d80_dump_rx_filter(struct aic880d80_private *priv, struct seq_file *s)
+{
+    struct net_device *netdev = priv->netdev;
+    unsigned int i;
+
+    netif_addr_lock_bh(netdev);
+    seq_printf(s, "mode: %#x%s%s%s%s\n", priv->rx_filter,
+               priv->rx_filter & AIC880D80_RX_FILTER_PROMISC ? " promisc" : "",
+               priv->rx_filter & AIC880D80_RX_FILTER_ALLMULTI ? " allmulti" : "",
+               priv->rx_filter & AIC880D80_RX_FILTER_UC_HASH ? " uc_hash" : "",
+               priv->rx_filter & AIC880D80_RX_FILTER_MC_HASH ? " mc_hash" : "");
+    seq_printf(s, "uc_hash: %016llx\nmc_hash: %016llx\n",
+               priv->rx_uc_hash, priv->rx_mc_hash);
+    for_each_set_bit(i, priv->rx_filter_used, AIC880D80_NUM_PERFECT_FILTERS)
+        seq_printf(s, "%2u: %pM\n", i, priv->rx_filter_addr[i]);
+    seq_printf(s, "register writes: %llu\n", priv->rx_filter_writes);
+    netif_addr_unlock_bh(netdev);
+}
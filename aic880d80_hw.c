@@ -2,6 +2,10 @@
  * aic880d80_hw.c - Hardware functions skeleton for AIC 880d80
  */
 #include "aic880d80.h"
+#include <linux/netdevice.h>
+#include <linux/ethtool.h>
+#include <linux/timekeeping.h>
+#include <linux/pm_runtime.h>
 
 
 int aic880d80_read_mac_address(struct aic880d80_private *priv, u8 *mac)
@@ -26,3 +30,172 @@ int aic880d80_set_mac_address(struct aic880d80_private *priv, const u8 *mac)
     aic880d80_write32(priv, AIC880D80_REG_MAC_HI, hi);
     return 0;
 }
+
+
+/*
+ * Add the MAC/PHY counters out of the device-written snapshot to @stats.
+ * This is a plain memory read; retry if the device was mid-update, and
+ * return false if it still was after the last try.
+ */
+static bool aic880d80_add_stats_block(const struct aic880d80_hw_stats_block *blk,
+                                      struct aic880d80_stats *stats)
+{
+    struct aic880d80_stats snap;
+    int retries = AIC880D80_STATS_READ_RETRIES;
+    bool torn;
+    u32 gen;
+
+    do {
+        gen = le32_to_cpu(READ_ONCE(blk->generation));
+        dma_rmb();
+        snap.rx_crc_errors = le64_to_cpu(blk->rx_crc_errors);
+        snap.rx_length_errors = le64_to_cpu(blk->rx_length_errors);
+        snap.rx_fifo_errors = le64_to_cpu(blk->rx_fifo_errors);
+        snap.tx_fifo_errors = le64_to_cpu(blk->tx_fifo_errors);
+        snap.rx_missed_errors = le64_to_cpu(blk->rx_missed_errors);
+        snap.tx_aborted_errors = le64_to_cpu(blk->tx_aborted_errors);
+        snap.tx_carrier_errors = le64_to_cpu(blk->tx_carrier_errors);
+        snap.tx_window_errors = le64_to_cpu(blk->tx_window_errors);
+        dma_rmb();
+        torn = (gen & 1) || gen != le32_to_cpu(READ_ONCE(blk->generation));
+    } while (torn && --retries);
+
+    stats->rx_crc_errors += snap.rx_crc_errors;
+    stats->rx_length_errors += snap.rx_length_errors;
+    stats->rx_fifo_errors += snap.rx_fifo_errors;
+    stats->tx_fifo_errors += snap.tx_fifo_errors;
+    stats->rx_missed_errors += snap.rx_missed_errors;
+    stats->tx_aborted_errors += snap.tx_aborted_errors;
+    stats->tx_carrier_errors += snap.tx_carrier_errors;
+    stats->tx_window_errors += snap.tx_window_errors;
+    return !torn;
+}
+
+/*
+ * MAC/PHY counters since probe: what earlier opens left in priv->hw_stats
+ * plus the live snapshot. The device resets them at every open. A
+ * snapshot still torn after the retries is used as is, each counter is
+ * a value the device did hold, but counted in hw_stats_torn.
+ */
+void aic880d80_read_hw_stats(struct aic880d80_private *priv,
+                             struct aic880d80_stats *stats)
+{
+    const struct aic880d80_hw_stats_block *blk;
+    const struct aic880d80_stats *base = &priv->hw_stats;
+
+    stats->rx_crc_errors = READ_ONCE(base->rx_crc_errors);
+    stats->rx_length_errors = READ_ONCE(base->rx_length_errors);
+    stats->rx_fifo_errors = READ_ONCE(base->rx_fifo_errors);
+    stats->tx_fifo_errors = READ_ONCE(base->tx_fifo_errors);
+    stats->rx_missed_errors = READ_ONCE(base->rx_missed_errors);
+    stats->tx_aborted_errors = READ_ONCE(base->tx_aborted_errors);
+    stats->tx_carrier_errors = READ_ONCE(base->tx_carrier_errors);
+    stats->tx_window_errors = READ_ONCE(base->tx_window_errors);
+
+    /* aic880d80_free_stats_block() waits for this with synchronize_net() */
+    rcu_read_lock();
+    blk = READ_ONCE(priv->stats_block);
+    if (blk && !aic880d80_add_stats_block(blk, stats))
+        WRITE_ONCE(priv->hw_stats_torn, priv->hw_stats_torn + 1);
+    rcu_read_unlock();
+}
+
+/*
+ * Fold the final snapshot into priv->hw_stats before the block is freed,
+ * so the counters carry over to the next open. The device is stopped and
+ * readers no longer see the block.
+ */
+void aic880d80_fold_hw_stats(struct aic880d80_private *priv,
+                             const struct aic880d80_hw_stats_block *blk)
+{
+    struct aic880d80_stats sum = {};
+
+    aic880d80_add_stats_block(blk, &sum);
+    WRITE_ONCE(priv->hw_stats.rx_crc_errors,
+               priv->hw_stats.rx_crc_errors + sum.rx_crc_errors);
+    WRITE_ONCE(priv->hw_stats.rx_length_errors,
+               priv->hw_stats.rx_length_errors + sum.rx_length_errors);
+    WRITE_ONCE(priv->hw_stats.rx_fifo_errors,
+               priv->hw_stats.rx_fifo_errors + sum.rx_fifo_errors);
+    WRITE_ONCE(priv->hw_stats.tx_fifo_errors,
+               priv->hw_stats.tx_fifo_errors + sum.tx_fifo_errors);
+    WRITE_ONCE(priv->hw_stats.rx_missed_errors,
+               priv->hw_stats.rx_missed_errors + sum.rx_missed_errors);
+    WRITE_ONCE(priv->hw_stats.tx_aborted_errors,
+               priv->hw_stats.tx_aborted_errors + sum.tx_aborted_errors);
+    WRITE_ONCE(priv->hw_stats.tx_carrier_errors,
+               priv->hw_stats.tx_carrier_errors + sum.tx_carrier_errors);
+    WRITE_ONCE(priv->hw_stats.tx_window_errors,
+               priv->hw_stats.tx_window_errors + sum.tx_window_errors);
+}
+
+
+static u32 aic880d80_speed_mbps(u32 status)
+{
+    static const u32 speeds[] = { 10, 100, 1000, 2500, 5000, 10000 };
+    u32 idx = AIC880D80_GET_SPEED(status);
+
+    return idx < ARRAY_SIZE(speeds) ? speeds[idx] : SPEED_UNKNOWN;
+}
+
+
+/*
+ * Refresh carrier state. Called once at open and then only from the
+ * AIC880D80_INT_LINK_CHANGE interrupt, never from a polling loop.
+ */
+void aic880d80_update_link(struct aic880d80_private *priv)
+{
+    u32 status = aic880d80_read32(priv, AIC880D80_REG_STATUS);
+    bool link_up = AIC880D80_IS_LINK_UP(status);
+
+    priv->link_speed = link_up ? aic880d80_speed_mbps(status) : SPEED_UNKNOWN;
+    priv->full_duplex = link_up && AIC880D80_IS_FULL_DUPLEX(status);
+
+    if (link_up == priv->link_up)
+        return;
+
+    priv->link_up = link_up;
+    if (link_up) {
+        netif_carrier_on(priv->netdev);
+        netdev_info(priv->netdev, "Link up, %u Mbps, %s duplex\n",
+                    priv->link_speed, priv->full_duplex ? "full" : "half");
+    } else {
+        netif_carrier_off(priv->netdev);
+        netdev_info(priv->netdev, "Link down\n");
+        /* Runtime idle schedules D3; PME brings the device back on link up */
+        pm_request_idle(priv->dev);
+    }
+}
+
+
+/* Program burst length, cache-line and prefetch policy from priv */
+void aic880d80_hw_set_dma_tuning(struct aic880d80_private *priv)
+{
+    u32 dma_ctrl = aic880d80_read32(priv, AIC880D80_REG_DMA_CTRL);
+
+    dma_ctrl &= ~AIC880D80_DMA_BURST_MASK;
+    dma_ctrl |= priv->dma_burst;
+    aic880d80_write32(priv, AIC880D80_REG_DMA_CTRL, dma_ctrl);
+    aic880d80_write32(priv, AIC880D80_REG_CACHE_CTRL, priv->cache_ctrl);
+    aic880d80_write32(priv, AIC880D80_REG_PREFETCH, priv->prefetch_ctrl);
+}
+
+/*
+ * ETF hands us launch times in CLOCK_TAI; the device compares against
+ * its own SYSTIME counter. Track the offset between the two, sampling
+ * TAI on both sides of the register read to bound the error.
+ */
+void aic880d80_sync_launch_clock(struct aic880d80_private *priv)
+{
+    u64 before, after, systime;
+    u32 lo, hi;
+
+    before = ktime_get_clocktai_ns();
+    lo = aic880d80_read32(priv, AIC880D80_REG_SYSTIME_LO);
+    hi = aic880d80_read32(priv, AIC880D80_REG_SYSTIME_HI);
+    after = ktime_get_clocktai_ns();
+
+    systime = ((u64)hi << 32) | lo;
+    WRITE_ONCE(priv->launch_offset_ns,
+               (s64)(before + (after - before) / 2) - (s64)systime);
+}
@@ -1,27 +1,66 @@
 /*
  * aic880d80_interrupt.c - Interrupt handler skeleton for AIC 880d80
+ *
+ * RX is serviced by NAPI, either from softirq or, with threaded NAPI,
+ * from a per-NAPI "napi/<dev>-<id>" kthread that can be pinned and given
+ * an RT priority. The RX interrupt is masked through INT_MASK from the
+ * moment NAPI is scheduled until the poll completes, so the poll loop
+ * is identical in both modes.
  */
 #include "aic880d80.h"
 #include <linux/interrupt.h>
 #include <linux/netdevice.h>
+#include <linux/spinlock.h>
+
+
+/*
+ * Mask or unmask RX_DONE only, leaving the other INT_MASK bits as they
+ * are. The lock keeps the handler and a poll completing on another CPU
+ * from undoing each other's write.
+ */
+static void aic880d80_mask_rx(struct aic880d80_private *priv, bool mask)
+{
+    unsigned long flags;
+    u32 val;
+
+    spin_lock_irqsave(&priv->int_mask_lock, flags);
+    val = aic880d80_read32_relaxed(priv, AIC880D80_REG_INT_MASK);
+    if (mask)
+        val |= AIC880D80_INT_RX_DONE;
+    else
+        val &= ~AIC880D80_INT_RX_DONE;
+    aic880d80_write32_relaxed(priv, AIC880D80_REG_INT_MASK, val);
+    spin_unlock_irqrestore(&priv->int_mask_lock, flags);
+}
 
 
 irqreturn_t aic880d80_interrupt(int irq, void *dev_id)
 {
-    struct net_device *netdev = dev_id;
-    struct aic880d80_private *priv = netdev_priv(netdev);
-    u32 status = aic880d80_read32(priv, AIC880D80_REG_INT_STS);
+    struct aic880d80_private *priv = dev_id;
+    /* Ordered read: completion must not see descriptors older than it */
+    u32 status = aic880d80_read32(priv, AIC880D80_REG_INT_STATUS);
     int handled = 0;
 
+    /* Shared line: not ours */
+    if (!status)
+        return IRQ_NONE;
+
     if (status & AIC880D80_INT_RX_DONE) {
-        napi_schedule(&priv->napi);
+        if (napi_schedule_prep(&priv->napi)) {
+            aic880d80_mask_rx(priv, true);
+            __napi_schedule(&priv->napi);
+        }
         handled = 1;
     }
     if (status & AIC880D80_INT_TX_DONE) {
-        aic880d80_clean_tx_ring(priv);
+        aic880d80_clean_tx_rings(priv);
         handled = 1;
     }
-    aic880d80_write32(priv, AIC880D80_REG_INT_STS, status);
+    if (status & AIC880D80_INT_LINK_CHANGE) {
+        aic880d80_update_link(priv);
+        handled = 1;
+    }
+    aic880d80_write32_relaxed(priv, AIC880D80_REG_INT_CLEAR, status);
     return handled ? IRQ_HANDLED : IRQ_NONE;
 }
 
@@ -29,10 +68,28 @@ irqreturn_t aic880d80_interrupt(int irq, void *dev_id)
 int aic880d80_napi_poll(struct napi_struct *napi, int budget)
 {
     struct aic880d80_private *priv = container_of(napi, struct aic880d80_private, napi);
-    int work_done = 0;
-    aic880d80_process_rx_ring(priv, budget);
-    // Si se procesó menos que el budget, completar NAPI
-    napi_complete_done(napi, work_done);
+    int work_done;
+
+    /* budget == 0 is netpoll asking for TX work only; RX must not run */
+    if (!budget)
+        return 0;
+
+    work_done = aic880d80_process_rx_ring(priv, budget);
+    if (test_and_clear_bit(AIC880D80_STATE_RX_SHRINK, &priv->state))
+        aic880d80_rx_shrink(priv);
     aic880d80_alloc_rx_buffers(priv);
+
+    /*
+     * Using the whole budget means there is more to do: stay scheduled
+     * and return budget, without completing. Otherwise complete, and
+     * unmask RX only if NAPI really went idle (busy polling may still
+     * own it).
+     */
+    if (work_done == budget)
+        return budget;
+
+    if (napi_complete_done(napi, work_done))
+        aic880d80_mask_rx(priv, false);
+
     return work_done;
 }
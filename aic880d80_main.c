@@ -13,18 +13,21 @@
 #include <linux/pm_runtime.h>
 #include <linux/prefetch.h>
 #include <linux/cpu_rmap.h>
+#include <linux/topology.h>
+#include <linux/sched/topology.h>
+#include <linux/cpu.h>
+#include <linux/cacheinfo.h>
+#include <linux/timekeeping.h>
+#include <linux/bitfield.h>
+#include <linux/udp.h>
+#include <linux/property.h>
+#include <linux/moduleparam.h>
 #include <linux/errno.h>         // ENODEV, ENOMEM, ETIMEDOUT
 #include <net/ip.h>
 #include <net/tcp.h>
+#include <net/pkt_sched.h>
+#include <net/pkt_cls.h>
 #include "aic880d80.h"
-
-// Stubs mínimos para evitar errores de linker
-static int aic880d80_probe(struct pci_dev *pdev, const struct pci_device_id *id) { return -ENODEV; }
-static void aic880d80_remove(struct pci_dev *pdev) { }
-static int aic880d80_suspend(struct device *dev) { return 0; }
-static int aic880d80_resume(struct device *dev) { return 0; }
-static irqreturn_t aic880d80_interrupt(int irq, void *data) { return IRQ_NONE; }
-static int aic880d80_poll(struct napi_struct *napi, int budget) { return 0; }
 /*
  * AIC semi AIC 880d80 Network Driver - Main Implementation
  * 
@@ -40,73 +43,6 @@ static int aic880d80_poll(struct napi_struct *napi, int budget) { return 0; }
 #define DRV_VERSION "1.0.0"
 #define DRV_DESCRIPTION "AIC semi AIC 880d80 Network Driver for ARM64"
 
-/* Private device structure */
-struct aic880d80_private {
-    struct net_device *netdev;
-    struct pci_dev *pdev;
-    void __iomem *iobase;
-    
-    /* DMA regions */
-    struct aic880d80_desc *rx_ring;
-    struct aic880d80_desc *tx_ring;
-    dma_addr_t rx_ring_dma;
-    dma_addr_t tx_ring_dma;
-    
-    /* SKB arrays */
-    struct sk_buff **rx_skbs;
-    struct sk_buff **tx_skbs;
-    dma_addr_t *rx_dma_addrs;
-    dma_addr_t *tx_dma_addrs;
-    
-    /* Ring indices */
-    u32 rx_head;
-    u32 rx_tail;
-    u32 tx_head;
-    u32 tx_tail;
-    u32 rx_ring_size;
-    u32 tx_ring_size;
-    
-    /* Locks */
-    spinlock_t tx_lock;
-    spinlock_t rx_lock;
-    
-    /* NAPI */
-    struct napi_struct napi;
-    
-    /* Statistics */
-    struct aic880d80_stats hw_stats;
-    
-    /* Work queues */
-    struct work_struct reset_work;
-    struct delayed_work watchdog_work;
-    
-    /* Power management */
-    bool pm_enabled;
-    u32 pm_state;
-    
-    /* ARM64 specific optimizations */
-    bool arm64_coherent_dma;
-    u32 arm64_cache_line_size;
-    bool neon_available;
-    
-    /* Hardware features */
-    u32 features;
-    u32 max_frame_size;
-    
-    /* Link state */
-    bool link_up;
-    u32 link_speed;
-    bool full_duplex;
-    
-    /* Interrupt management */
-    int irq;
-    char irq_name[32];
-    
-    /* Message level */
-    u32 msg_enable;
-};
-
-
 /* PCI device table */
 static const struct pci_device_id aic880d80_pci_tbl[] = {
     { PCI_DEVICE(AIC880D80_VENDOR_ID, AIC880D80_DEVICE_ID) },
@@ -114,15 +50,183 @@ static const struct pci_device_id aic880d80_pci_tbl[] = {
 };
 MODULE_DEVICE_TABLE(pci, aic880d80_pci_tbl);
 
-/* Utility functions */
-static inline u32 aic880d80_read32(struct aic880d80_private *priv, u32 reg)
+/*
+ * Module parameters. They override the matching device properties
+ * ("aic,rx-ring-size", ...) which in turn override the built-in defaults;
+ * 0 / -1 means "not set".
+ */
+static int debug = -1;
+module_param(debug, int, 0444);
+MODULE_PARM_DESC(debug, "netif message level (-1 = default)");
+
+static unsigned int rx_ring_size;
+module_param(rx_ring_size, uint, 0444);
+MODULE_PARM_DESC(rx_ring_size, "RX descriptors per ring (64-1024, 0 = DT/default)");
+
+static unsigned int tx_ring_size;
+module_param(tx_ring_size, uint, 0444);
+MODULE_PARM_DESC(tx_ring_size, "TX descriptors per ring (64-1024, 0 = DT/default)");
+
+static unsigned int burst_length;
+module_param(burst_length, uint, 0444);
+MODULE_PARM_DESC(burst_length, "DMA burst in words: 4, 8, 16 or 32 (0 = DT/default)");
+
+static int prefetch_enabled = -1;
+module_param(prefetch_enabled, int, 0444);
+MODULE_PARM_DESC(prefetch_enabled, "Descriptor/data prefetch (0 = off, 1 = on, -1 = DT/default)");
+
+static unsigned int rx_refill_low;
+module_param(rx_refill_low, uint, 0444);
+MODULE_PARM_DESC(rx_refill_low, "RX buffers kept posted under memory pressure (0 = ring/4)");
+
+static unsigned int rx_refill_high;
+module_param(rx_refill_high, uint, 0444);
+MODULE_PARM_DESC(rx_refill_high, "RX buffers posted under traffic (0 = ring - 1)");
+
+static unsigned int rx_refill_batch;
+module_param(rx_refill_batch, uint, 0444);
+MODULE_PARM_DESC(rx_refill_batch, "RX buffers posted per refill step (0 = 32)");
+
+static unsigned int rx_copybreak = AIC880D80_RX_COPYBREAK;
+module_param(rx_copybreak, uint, 0444);
+MODULE_PARM_DESC(rx_copybreak, "Copy received frames up to this size into a new skb");
+
+static bool rx_mprq;
+module_param(rx_mprq, bool, 0444);
+MODULE_PARM_DESC(rx_mprq, "Striding RX: pack frames into strides of 32 KiB buffers (0 = DT/off)");
+
+static unsigned int rx_mprq_stride;
+module_param(rx_mprq_stride, uint, 0444);
+MODULE_PARM_DESC(rx_mprq_stride, "Striding RX stride in bytes, power of two 64-2048 (0 = DT/256)");
+
+static unsigned int tx_copybreak = AIC880D80_TX_COPYBREAK;
+module_param(tx_copybreak, uint, 0444);
+MODULE_PARM_DESC(tx_copybreak, "DMA pool: copy TX frames up to this size into pre-mapped slots (0 = never)");
+
+static int dma_pool = -1;
+module_param(dma_pool, int, 0444);
+MODULE_PARM_DESC(dma_pool, "Keep ring buffers mapped across packets: RX page_pool, TX bounce slots (0 = off, 1 = on, -1 = on behind an IOMMU)");
+
+static bool napi_threaded;
+module_param(napi_threaded, bool, 0444);
+MODULE_PARM_DESC(napi_threaded, "Poll RX from per-NAPI kthreads by default (see sysfs 'threaded')");
+
+static bool calibrate_dma;
+module_param(calibrate_dma, bool, 0444);
+MODULE_PARM_DESC(calibrate_dma, "Measure burst/prefetch settings over MAC loopback at probe");
+
+static bool emulate;
+module_param(emulate, bool, 0444);
+MODULE_PARM_DESC(emulate, "Also register an emulated loopback device (no hardware needed)");
+
+static u32 aic880d80_config_u32(struct device *dev, unsigned int param,
+                                const char *prop, u32 def)
 {
-    return readl(priv->iobase + reg);
+    u32 val;
+
+    if (param)
+        return param;
+    if (!device_property_read_u32(dev, prop, &val))
+        return val;
+    return def;
 }
 
-static inline void aic880d80_write32(struct aic880d80_private *priv, u32 reg, u32 val)
+/*
+ * Resolve ring, buffer and DMA tuning from module parameters, firmware
+ * properties and defaults. The result only lives in priv; hw_reset() and
+ * hw_init() program it into the device.
+ */
+static void aic880d80_load_config(struct aic880d80_private *priv)
 {
-    writel(val, priv->iobase + reg);
+    struct device *dev = priv->dev;
+    u32 burst, line;
+    bool prefetch;
+
+    priv->rx_ring_size = clamp_t(u32,
+                                 aic880d80_config_u32(dev, rx_ring_size,
+                                                      "aic,rx-ring-size",
+                                                      AIC880D80_RX_RING_SIZE),
+                                 AIC880D80_MIN_RING_SIZE,
+                                 AIC880D80_MAX_RING_SIZE);
+    priv->tx_ring_size = clamp_t(u32,
+                                 aic880d80_config_u32(dev, tx_ring_size,
+                                                      "aic,tx-ring-size",
+                                                      AIC880D80_TX_RING_SIZE),
+                                 AIC880D80_MIN_RING_SIZE,
+                                 AIC880D80_MAX_RING_SIZE);
+    priv->rx_buf_size = clamp_t(u32,
+                                aic880d80_config_u32(dev, 0, "aic,rx-buffer-size",
+                                                     AIC880D80_RX_BUFFER_SIZE),
+                                AIC880D80_MIN_RX_BUFFER_SIZE,
+                                AIC880D80_MAX_FRAME_SIZE);
+
+    /*
+     * Striding RX: a handful of large buffers replaces the per-frame
+     * ring, the refill watermarks below then count buffers.
+     */
+    priv->rx_mprq = rx_mprq || device_property_read_bool(dev, "aic,rx-striding");
+    if (priv->rx_mprq) {
+        priv->rx_ring_size = AIC880D80_MPRQ_RING_SIZE;
+        priv->rx_mprq_stride = aic880d80_config_u32(dev, rx_mprq_stride,
+                                                    "aic,rx-stride-size",
+                                                    AIC880D80_MPRQ_STRIDE);
+        priv->rx_mprq_stride = rounddown_pow_of_two(clamp_t(u32, priv->rx_mprq_stride,
+                                                            AIC880D80_MPRQ_STRIDE_MIN,
+                                                            AIC880D80_MPRQ_STRIDE_MAX));
+    }
+
+    /* low <= high < ring size, one slot always stays empty */
+    priv->rx_refill_high = min(aic880d80_config_u32(dev, rx_refill_high,
+                                                    "aic,rx-refill-high",
+                                                    priv->rx_ring_size - 1),
+                               priv->rx_ring_size - 1);
+    priv->rx_refill_low = min(aic880d80_config_u32(dev, rx_refill_low,
+                                                   "aic,rx-refill-low",
+                                                   priv->rx_ring_size / 4),
+                              priv->rx_refill_high);
+    priv->rx_refill_batch = clamp_t(u32,
+                                    aic880d80_config_u32(dev, rx_refill_batch,
+                                                         "aic,rx-refill-batch",
+                                                         AIC880D80_RX_REFILL_BATCH),
+                                    1, priv->rx_refill_high);
+
+    burst = aic880d80_config_u32(dev, burst_length, "aic,burst-length", 16);
+    switch (burst) {
+    case 4:
+    case 8:
+    case 16:
+    case 32:
+        break;
+    default:
+        dev_warn(dev, "Invalid DMA burst length %u, using 16\n", burst);
+        burst = 16;
+    }
+    priv->dma_burst = AIC880D80_DMA_BURST(burst);
+
+    line = aic880d80_config_u32(dev, 0, "cache-line-size", cache_line_size());
+    priv->cache_ctrl = line >= 128 ? AIC880D80_CACHE_LINE_128 :
+                                     AIC880D80_CACHE_LINE_64;
+    if (priv->arm64_coherent_dma)
+        priv->cache_ctrl |= AIC880D80_CACHE_COHERENT;
+
+    /* Without firmware properties keep the historical "prefetch on" */
+    if (prefetch_enabled >= 0)
+        prefetch = prefetch_enabled;
+    else
+        prefetch = !dev_fwnode(dev) ||
+                   device_property_read_bool(dev, "aic,prefetch-enabled");
+    priv->prefetch_ctrl = 0;
+    if (prefetch) {
+        priv->cache_ctrl |= AIC880D80_CACHE_PREFETCH;
+        priv->prefetch_ctrl = AIC880D80_PREFETCH_DESC | AIC880D80_PREFETCH_DATA;
+    }
+
+    /* Per-packet mappings are what an IOMMU makes expensive */
+    priv->dma_pool = dma_pool >= 0 ? dma_pool : device_iommu_mapped(dev);
+
+    dev_dbg(dev, "rings %u/%u, rx buffer %u, burst %u, cache %#x, prefetch %#x, pool %d\n",
+            priv->rx_ring_size, priv->tx_ring_size, priv->rx_buf_size,
+            burst, priv->cache_ctrl, priv->prefetch_ctrl, priv->dma_pool);
 }
 
 /* ARM64 specific cache operations */
@@ -135,35 +239,13 @@ static inline void aic880d80_prefetch_descriptor(struct aic880d80_desc *desc)
 #endif
 }
 
-static inline void aic880d80_dma_sync_desc_for_cpu(struct aic880d80_private *priv,
-                                                   struct aic880d80_desc *desc)
-{
-    if (!priv->arm64_coherent_dma) {
-        dma_sync_single_for_cpu(&priv->pdev->dev, 
-                               virt_to_phys(desc), 
-                               sizeof(*desc), 
-                               DMA_BIDIRECTIONAL);
-    }
-}
-
-static inline void aic880d80_dma_sync_desc_for_device(struct aic880d80_private *priv,
-                                                     struct aic880d80_desc *desc)
-{
-    if (!priv->arm64_coherent_dma) {
-        dma_sync_single_for_device(&priv->pdev->dev, 
-                                  virt_to_phys(desc), 
-                                  sizeof(*desc), 
-                                  DMA_BIDIRECTIONAL);
-    }
-}
-
 /* Hardware reset function */
 static int aic880d80_hw_reset(struct aic880d80_private *priv)
 {
     u32 ctrl;
     int timeout = 1000;
     
-    dev_dbg(&priv->pdev->dev, "Resetting hardware\n");
+    dev_dbg(priv->dev, "Resetting hardware\n");
     
     /* Trigger reset */
     aic880d80_write32(priv, AIC880D80_REG_CTRL, AIC880D80_CTRL_RESET);
@@ -177,7 +259,7 @@ static int aic880d80_hw_reset(struct aic880d80_private *priv)
     }
     
     if (timeout <= 0) {
-        dev_err(&priv->pdev->dev, "Hardware reset timeout\n");
+        dev_err(priv->dev, "Hardware reset timeout\n");
         return -ETIMEDOUT;
     }
     
@@ -185,24 +267,45 @@ static int aic880d80_hw_reset(struct aic880d80_private *priv)
     ctrl = aic880d80_read32(priv, AIC880D80_REG_CTRL);
     if (priv->arm64_coherent_dma)
         ctrl |= AIC880D80_CTRL_CACHE_COH;
-    ctrl |= AIC880D80_CTRL_ARM64_OPT | AIC880D80_CTRL_PREFETCH_EN;
+    ctrl |= AIC880D80_CTRL_ARM64_OPT;
+    if (priv->prefetch_ctrl)
+        ctrl |= AIC880D80_CTRL_PREFETCH_EN;
     aic880d80_write32(priv, AIC880D80_REG_CTRL, ctrl);
     
-    /* Configure cache control for ARM64 */
-    aic880d80_write32(priv, AIC880D80_REG_CACHE_CTRL, 
-                     AIC880D80_CACHE_COHERENT | 
-                     AIC880D80_CACHE_LINE_64 |
-                     AIC880D80_CACHE_PREFETCH);
+    /* Cache line and prefetch policy as resolved by load_config() */
+    aic880d80_write32(priv, AIC880D80_REG_CACHE_CTRL, priv->cache_ctrl);
+    aic880d80_write32(priv, AIC880D80_REG_PREFETCH, priv->prefetch_ctrl);
     
-    dev_dbg(&priv->pdev->dev, "Hardware reset completed\n");
+    dev_dbg(priv->dev, "Hardware reset completed\n");
     return 0;
 }
 
+/* Point a hardware TX ring at its descriptors, with empty head/tail */
+static void aic880d80_program_tx_ring(struct aic880d80_private *priv,
+                                      struct aic880d80_ring *tx)
+{
+    u32 q = tx->queue_index;
+    
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_DESC_LO),
+                     lower_32_bits(tx->desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_DESC_HI),
+                     upper_32_bits(tx->desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_DESC_LEN),
+                     tx->size);
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_WEIGHT),
+                     priv->tx_weight[q]);
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_CTRL),
+                     test_bit(q, &priv->tx_launch_queues) ?
+                     AIC880D80_TXQ_CTRL_LAUNCH : 0);
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_HEAD), 0);
+    aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_TAIL), 0);
+}
+
 /* Initialize hardware */
 static int aic880d80_hw_init(struct aic880d80_private *priv)
 {
     int ret;
-    u32 dma_ctrl;
+    u32 dma_ctrl, q;
     
     /* Reset hardware */
     ret = aic880d80_hw_reset(priv);
@@ -210,37 +313,64 @@ static int aic880d80_hw_init(struct aic880d80_private *priv)
         return ret;
     
     /* Configure DMA for ARM64 */
-    dma_ctrl = AIC880D80_DMA_ENABLE | AIC880D80_DMA_64BIT;
+    dma_ctrl = AIC880D80_DMA_ENABLE | AIC880D80_DMA_64BIT |
+               AIC880D80_DMA_RX_ENABLE | AIC880D80_DMA_TX_ENABLE;
     
     if (priv->arm64_coherent_dma)
         dma_ctrl |= AIC880D80_DMA_COHERENT;
         
-    /* Set optimal burst size for ARM64 */
-    dma_ctrl |= AIC880D80_DMA_BURST_16;
+    /* Burst length from DT/module parameter or calibration */
+    dma_ctrl |= priv->dma_burst;
     
     aic880d80_write32(priv, AIC880D80_REG_DMA_CTRL, dma_ctrl);
     
     /* Set descriptor ring addresses */
     aic880d80_write32(priv, AIC880D80_REG_RX_DESC_LO, 
-                     lower_32_bits(priv->rx_ring_dma));
+                     lower_32_bits(priv->rx_ring->desc_dma));
     aic880d80_write32(priv, AIC880D80_REG_RX_DESC_HI, 
-                     upper_32_bits(priv->rx_ring_dma));
-    aic880d80_write32(priv, AIC880D80_REG_TX_DESC_LO, 
-                     lower_32_bits(priv->tx_ring_dma));
-    aic880d80_write32(priv, AIC880D80_REG_TX_DESC_HI, 
-                     upper_32_bits(priv->tx_ring_dma));
-    
-    /* Set ring sizes */
-    aic880d80_write32(priv, AIC880D80_REG_RX_DESC_LEN, priv->rx_ring_size);
-    aic880d80_write32(priv, AIC880D80_REG_TX_DESC_LEN, priv->tx_ring_size);
-    
-    /* Initialize ring pointers */
-    aic880d80_write32(priv, AIC880D80_REG_RX_HEAD, 0);
-    aic880d80_write32(priv, AIC880D80_REG_RX_TAIL, 0);
-    aic880d80_write32(priv, AIC880D80_REG_TX_HEAD, 0);
-    aic880d80_write32(priv, AIC880D80_REG_TX_TAIL, 0);
-    
-    /* Enable interrupts */
+                     upper_32_bits(priv->rx_ring->desc_dma));
+    aic880d80_write32(priv, AIC880D80_REG_RX_DESC_LEN, priv->rx_ring->size);
+    if (priv->rx_mprq) {
+        aic880d80_write32(priv, AIC880D80_REG_RX_CQ_LO,
+                         lower_32_bits(priv->rx_ring->cqe_dma));
+        aic880d80_write32(priv, AIC880D80_REG_RX_CQ_HI,
+                         upper_32_bits(priv->rx_ring->cqe_dma));
+        aic880d80_write32(priv, AIC880D80_REG_RX_CQ_LEN, AIC880D80_MPRQ_CQ_SIZE);
+        aic880d80_write32(priv, AIC880D80_REG_RX_CQ_HEAD, priv->rx_ring->cq_head);
+        aic880d80_write32(priv, AIC880D80_REG_RX_MPRQ,
+                         AIC880D80_RX_MPRQ_ENABLE |
+                         FIELD_PREP(AIC880D80_RX_MPRQ_STRIDE_SHIFT,
+                                    ilog2(priv->rx_mprq_stride)) |
+                         FIELD_PREP(AIC880D80_RX_MPRQ_STRIDES,
+                                    AIC880D80_MPRQ_BUF_SIZE / priv->rx_mprq_stride));
+    }
+    /* Fresh rings start at 0; after a resume the posted buffers are reused */
+    aic880d80_write32(priv, AIC880D80_REG_RX_HEAD, priv->rx_ring->tail);
+    aic880d80_write32(priv, AIC880D80_REG_RX_TAIL, priv->rx_ring->head);
+    
+    /* One hardware TX ring per traffic class, arbitrated by TX_SCHED */
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++)
+        if (priv->tx_ring[q])
+            aic880d80_program_tx_ring(priv, priv->tx_ring[q]);
+    aic880d80_write32(priv, AIC880D80_REG_TX_SCHED, priv->tx_sched);
+    
+    /* Reset cleared the address filters, reprogram the current lists */
+    aic880d80_restore_rx_filter(priv);
+    
+    /* Let the device push MAC/PHY counters instead of us polling them */
+    if (priv->stats_block) {
+        aic880d80_write32(priv, AIC880D80_REG_STATS_DMA_LO,
+                         lower_32_bits(priv->stats_block_dma));
+        aic880d80_write32(priv, AIC880D80_REG_STATS_DMA_HI,
+                         upper_32_bits(priv->stats_block_dma));
+        aic880d80_write32(priv, AIC880D80_REG_STATS_DMA_CTRL,
+                         AIC880D80_STATS_DMA_ENABLE |
+                         (AIC880D80_STATS_DMA_PERIOD_MS <<
+                          AIC880D80_STATS_DMA_PERIOD_SHIFT));
+    }
+    
+    /* Enable interrupts, RX is only masked while NAPI is scheduled */
+    aic880d80_write32(priv, AIC880D80_REG_INT_MASK, 0);
     aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE,
                      AIC880D80_INT_RX_DONE | AIC880D80_INT_TX_DONE |
                      AIC880D80_INT_LINK_CHANGE | AIC880D80_INT_RX_ERROR |
@@ -249,155 +379,586 @@ static int aic880d80_hw_init(struct aic880d80_private *priv)
     return 0;
 }
 
+/*
+ * Pick the CPU that services a queue's interrupt and place the queue's
+ * memory on that CPU's node. Candidates are the online CPUs local to the
+ * device, or all online CPUs if it has none, narrowed to those with the
+ * highest capacity so that on big.LITTLE the interrupt and NAPI land on
+ * a big core. Queues are spread over the candidates in order.
+ */
+static void aic880d80_set_queue_placement(struct aic880d80_private *priv,
+                                          unsigned int queue)
+{
+    unsigned long cap, best = 0;
+    cpumask_var_t mask;
+    unsigned int cpu;
+    
+    priv->numa_node = dev_to_node(priv->dev);
+    priv->irq_cpu = cpumask_local_spread(queue, priv->numa_node);
+    if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+        goto out;
+    
+    cpus_read_lock();
+    if (priv->numa_node != NUMA_NO_NODE)
+        cpumask_and(mask, cpumask_of_node(priv->numa_node), cpu_online_mask);
+    if (cpumask_empty(mask))
+        cpumask_copy(mask, cpu_online_mask);
+    
+    for_each_cpu(cpu, mask)
+        best = max(best, arch_scale_cpu_capacity(cpu));
+    for_each_cpu(cpu, mask) {
+        cap = arch_scale_cpu_capacity(cpu);
+        if (cap < best)
+            __cpumask_clear_cpu(cpu, mask);
+    }
+    priv->irq_cpu = cpumask_nth(queue % cpumask_weight(mask), mask);
+    cpus_read_unlock();
+    
+    free_cpumask_var(mask);
+out:
+    priv->ring_node = cpu_to_node(priv->irq_cpu);
+}
+
+/*
+ * CPUs sharing @cpu's L2, from the cache topology. Without cacheinfo for
+ * it fall back to the scheduler's cluster, which is the L2 on most arm64
+ * parts but not guaranteed to be.
+ */
+const struct cpumask *aic880d80_xps_cpus(int cpu)
+{
+    struct cpu_cacheinfo *cci = get_cpu_cacheinfo(cpu);
+    u32 i;
+    
+    for (i = 0; cci && cci->info_list && i < cci->num_leaves; i++) {
+        struct cacheinfo *ci = &cci->info_list[i];
+        
+        if (ci->level == 2 && ci->type != CACHE_TYPE_INST)
+            return &ci->shared_cpu_map;
+    }
+    return topology_cluster_cpumask(cpu);
+}
+
+/*
+ * XPS: transmit from the CPUs sharing the interrupt CPU's L2 on our rings,
+ * so completions reclaimed by NAPI there stay cache local. Other CPUs keep
+ * the default hash. Queues lent to offloaded macvlans belong to them and
+ * are skipped. Only done while the device has no XPS map at all, so a map
+ * set through sysfs, or ours from an earlier open, is left alone.
+ */
+static void aic880d80_set_xps(struct aic880d80_private *priv)
+{
+    const struct cpumask *mask;
+    u32 q;
+    int ret;
+    
+#ifdef CONFIG_XPS
+    if (rcu_access_pointer(priv->netdev->xps_maps[XPS_CPUS]))
+        return;
+#endif
+    
+    mask = aic880d80_xps_cpus(priv->irq_cpu);
+    for (q = 0; q < priv->num_tx_rings; q++) {
+        if (priv->fwd_station[q])
+            continue;
+        ret = netif_set_xps_queue(priv->netdev, mask, q);
+        if (ret)
+            netdev_dbg(priv->netdev, "XPS on TX queue %u: %d\n", q, ret);
+    }
+}
+
+/* Allocate descriptor memory on the queue's node, falling back to any node */
+static void *aic880d80_alloc_desc_ring(struct aic880d80_private *priv, size_t size,
+                                       dma_addr_t *dma)
+{
+    struct device *dev = priv->dev;
+    int orig_node = dev_to_node(dev);
+    void *ring;
+    
+    set_dev_node(dev, priv->ring_node);
+    ring = dma_alloc_coherent(dev, size, dma, GFP_KERNEL);
+    set_dev_node(dev, orig_node);
+    
+    if (!ring)
+        ring = dma_alloc_coherent(dev, size, dma, GFP_KERNEL);
+    return ring;
+}
+
+/* Allocate a ring object, its buffer-info table and descriptor memory */
+static struct aic880d80_ring *aic880d80_alloc_ring(struct aic880d80_private *priv,
+                                                   u32 size, u32 queue_index)
+{
+    struct aic880d80_ring *ring;
+    
+    ring = kzalloc_node(sizeof(*ring), GFP_KERNEL, priv->ring_node);
+    if (!ring)
+        return NULL;
+    
+    ring->priv = priv;
+    ring->size = size;
+    ring->queue_index = queue_index;
+    ring->node = priv->ring_node;
+    
+    ring->buf = kcalloc_node(size, sizeof(*ring->buf), GFP_KERNEL, ring->node);
+    if (!ring->buf)
+        goto err_buf;
+    
+    ring->desc = aic880d80_alloc_desc_ring(priv, sizeof(*ring->desc) * size,
+                                           &ring->desc_dma);
+    if (!ring->desc)
+        goto err_desc;
+    
+    return ring;
+
+err_desc:
+    kfree(ring->buf);
+err_buf:
+    kfree(ring);
+    return NULL;
+}
+
+/* Unmap and free every buffer still attached to a ring, then the ring */
+static void aic880d80_free_ring(struct aic880d80_private *priv,
+                                struct aic880d80_ring *ring,
+                                enum dma_data_direction dir)
+{
+    u32 i;
+    
+    for (i = 0; i < ring->size; i++) {
+        struct aic880d80_buffer_info *bi = &ring->buf[i];
+        
+        if (dir == DMA_FROM_DEVICE) {
+            aic880d80_rx_free_buffer(priv, bi);
+            continue;
+        }
+        aic880d80_unmap_tx_buffer(priv, bi);
+        if (bi->skb)
+            dev_kfree_skb(bi->skb);
+    }
+    
+    if (ring->cqe)
+        dma_free_coherent(priv->dev, sizeof(*ring->cqe) * AIC880D80_MPRQ_CQ_SIZE,
+                          ring->cqe, ring->cqe_dma);
+    dma_free_coherent(priv->dev, sizeof(*ring->desc) * ring->size,
+                      ring->desc, ring->desc_dma);
+    kfree(ring->buf);
+    kfree(ring);
+}
+
+/*
+ * TX rings to allocate at open. With L2 forwarding offload on, the idle
+ * station rings are allocated too, so a macvlan comes and goes without
+ * the rings being reallocated.
+ */
+static u32 aic880d80_tx_rings_alloc(const struct aic880d80_private *priv)
+{
+    return priv->netdev->features & NETIF_F_HW_L2FW_DOFFLOAD ?
+           AIC880D80_MAX_TX_QUEUES : priv->num_tx_rings;
+}
+
 /* Allocate and setup DMA rings */
 static int aic880d80_setup_rings(struct aic880d80_private *priv)
 {
-    size_t rx_ring_size, tx_ring_size;
-    int i;
-    
-    priv->rx_ring_size = AIC880D80_RX_RING_SIZE;
-    priv->tx_ring_size = AIC880D80_TX_RING_SIZE;
+    struct aic880d80_ring *rx, *tx[AIC880D80_MAX_TX_QUEUES] = {};
+    u32 i, q;
     
-    /* Allocate RX ring */
-    rx_ring_size = sizeof(struct aic880d80_desc) * priv->rx_ring_size;
-    priv->rx_ring = dma_alloc_coherent(&priv->pdev->dev, rx_ring_size,
-                                      &priv->rx_ring_dma, GFP_KERNEL);
-    if (!priv->rx_ring) {
-        dev_err(&priv->pdev->dev, "Failed to allocate RX ring\n");
+    rx = aic880d80_alloc_ring(priv, priv->rx_ring_size, 0);
+    if (!rx) {
+        dev_err(priv->dev, "Failed to allocate RX ring\n");
         return -ENOMEM;
     }
     
-    /* Allocate TX ring */
-    tx_ring_size = sizeof(struct aic880d80_desc) * priv->tx_ring_size;
-    priv->tx_ring = dma_alloc_coherent(&priv->pdev->dev, tx_ring_size,
-                                      &priv->tx_ring_dma, GFP_KERNEL);
-    if (!priv->tx_ring) {
-        dev_err(&priv->pdev->dev, "Failed to allocate TX ring\n");
-        goto err_tx_ring;
+    /* Striding RX completes frames through its own queue */
+    if (priv->rx_mprq) {
+        rx->cqe = aic880d80_alloc_desc_ring(priv, sizeof(*rx->cqe) *
+                                            AIC880D80_MPRQ_CQ_SIZE, &rx->cqe_dma);
+        if (!rx->cqe) {
+            dev_err(priv->dev, "Failed to allocate RX completion queue\n");
+            goto err_tx_ring;
+        }
+        rx->cq_phase = 1;
     }
     
-    /* Allocate SKB arrays */
-    priv->rx_skbs = kcalloc(priv->rx_ring_size, sizeof(struct sk_buff *), GFP_KERNEL);
-    if (!priv->rx_skbs)
-        goto err_rx_skbs;
-        
-    priv->tx_skbs = kcalloc(priv->tx_ring_size, sizeof(struct sk_buff *), GFP_KERNEL);
-    if (!priv->tx_skbs)
-        goto err_tx_skbs;
-    
-    /* Allocate DMA address arrays */
-    priv->rx_dma_addrs = kcalloc(priv->rx_ring_size, sizeof(dma_addr_t), GFP_KERNEL);
-    if (!priv->rx_dma_addrs)
-        goto err_rx_dma;
-        
-    priv->tx_dma_addrs = kcalloc(priv->tx_ring_size, sizeof(dma_addr_t), GFP_KERNEL);
-    if (!priv->tx_dma_addrs)
-        goto err_tx_dma;
-    
-    /* Initialize ring indices */
-    priv->rx_head = 0;
-    priv->rx_tail = 0;
-    priv->tx_head = 0;
-    priv->tx_tail = 0;
-    
-    /* Initialize descriptors */
-    memset(priv->rx_ring, 0, rx_ring_size);
-    memset(priv->tx_ring, 0, tx_ring_size);
-    
-    /* Allocate RX buffers */
-    for (i = 0; i < priv->rx_ring_size; i++) {
-        struct sk_buff *skb;
-        dma_addr_t dma_addr;
-        
-        skb = netdev_alloc_skb_ip_align(priv->netdev, AIC880D80_RX_BUFFER_SIZE);
-        if (!skb) {
-            dev_err(&priv->pdev->dev, "Failed to allocate RX buffer %d\n", i);
-            goto err_rx_buffers;
+    for (q = 0; q < aic880d80_tx_rings_alloc(priv); q++) {
+        tx[q] = aic880d80_alloc_ring(priv, priv->tx_ring_size, q);
+        if (!tx[q]) {
+            dev_err(priv->dev, "Failed to allocate TX ring %u\n", q);
+            goto err_tx_ring;
         }
+        if (priv->push_base)
+            tx[q]->push = priv->push_base + AIC880D80_PUSH_WINDOW(q);
+    }
+    
+    /* Not fatal: without the pools buffers are mapped per packet */
+    if (priv->dma_pool && priv->tx_copybreak && aic880d80_pool_init(priv, tx))
+        netdev_warn(priv->netdev, "No memory for the TX bounce pool, mapping per packet\n");
+    if (priv->dma_pool && !priv->rx_mprq && aic880d80_rx_pp_create(priv, rx))
+        netdev_warn(priv->netdev, "No page_pool for RX, mapping per packet\n");
+    
+    /* Start at the high watermark; head == tail means the ring is empty */
+    for (i = 0; i < priv->rx_refill_high; i++) {
+        struct aic880d80_buffer_info *bi = &rx->buf[i];
         
-        dma_addr = dma_map_single(&priv->pdev->dev, skb->data,
-                                 AIC880D80_RX_BUFFER_SIZE, DMA_FROM_DEVICE);
-        if (dma_mapping_error(&priv->pdev->dev, dma_addr)) {
-            dev_err(&priv->pdev->dev, "Failed to map RX buffer %d\n", i);
-            dev_kfree_skb(skb);
+        if (aic880d80_rx_alloc_buffer(priv, bi, GFP_KERNEL)) {
+            dev_err(priv->dev, "Failed to allocate RX buffer %u\n", i);
             goto err_rx_buffers;
         }
-        
-        priv->rx_skbs[i] = skb;
-        priv->rx_dma_addrs[i] = dma_addr;
-        priv->rx_ring[i].buffer_addr = cpu_to_le64(dma_addr);
-        priv->rx_ring[i].length = cpu_to_le32(AIC880D80_RX_BUFFER_SIZE);
-        priv->rx_ring[i].status = cpu_to_le32(AIC880D80_DESC_OWN);
+        rx->desc[i].buffer_addr = cpu_to_le64(bi->dma);
+        AIC880D80_DESC_SET_LEN(&rx->desc[i], aic880d80_rx_desc_len(priv));
+        rx->desc[i].status = cpu_to_le32(AIC880D80_DESC_OWN);
     }
+    rx->head = i;
+    priv->rx_fill_target = priv->rx_refill_high;
+    priv->rx_posted = i;
     
+    priv->rx_ring = rx;
+    memcpy(priv->tx_ring, tx, sizeof(tx));
     return 0;
 
 err_rx_buffers:
-    for (i = 0; i < priv->rx_ring_size; i++) {
-        if (priv->rx_skbs[i]) {
-            if (priv->rx_dma_addrs[i])
-                dma_unmap_single(&priv->pdev->dev, priv->rx_dma_addrs[i],
-                               AIC880D80_RX_BUFFER_SIZE, DMA_FROM_DEVICE);
-            dev_kfree_skb(priv->rx_skbs[i]);
-        }
-    }
-    kfree(priv->tx_dma_addrs);
-err_tx_dma:
-    kfree(priv->rx_dma_addrs);
-err_rx_dma:
-    kfree(priv->tx_skbs);
-err_tx_skbs:
-    kfree(priv->rx_skbs);
-err_rx_skbs:
-    dma_free_coherent(&priv->pdev->dev, tx_ring_size, priv->tx_ring, priv->tx_ring_dma);
 err_tx_ring:
-    dma_free_coherent(&priv->pdev->dev, rx_ring_size, priv->rx_ring, priv->rx_ring_dma);
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++)
+        if (tx[q])
+            aic880d80_free_ring(priv, tx[q], DMA_TO_DEVICE);
+    aic880d80_free_ring(priv, rx, DMA_FROM_DEVICE);
+    aic880d80_rx_pp_destroy(priv);
+    aic880d80_pool_free(priv);
     return -ENOMEM;
 }
 
+/* Fold a ring's counters into the device totals before it goes away */
+static void aic880d80_fold_ring_stats(struct aic880d80_ring *ring, bool tx)
+{
+    struct aic880d80_stats *stats = &ring->priv->hw_stats;
+    
+    if (tx) {
+        struct aic880d80_tc_stats *tc = &ring->priv->tc_stats[ring->queue_index];
+        
+        stats->tx_packets += ring->packets;
+        stats->tx_bytes += ring->bytes;
+        stats->tx_dropped += ring->dropped;
+        tc->packets += ring->packets;
+        tc->bytes += ring->bytes;
+        tc->dropped += ring->dropped;
+        tc->stops += ring->stops;
+        tc->uso_packets += ring->uso_packets;
+        tc->uso_segs += ring->uso_segs;
+        tc->pushes += ring->pushes;
+        tc->reports += ring->reports;
+        tc->dma_maps += ring->dma_maps;
+        tc->dma_unmaps += ring->dma_unmaps;
+        tc->pool_copies += ring->pool_copies;
+    } else {
+        stats->rx_packets += ring->packets;
+        stats->rx_bytes += ring->bytes;
+        stats->rx_dropped += ring->dropped;
+    }
+}
+
 /* Free DMA rings */
 static void aic880d80_free_rings(struct aic880d80_private *priv)
 {
-    int i;
+    struct aic880d80_ring *rx = priv->rx_ring;
+    struct aic880d80_ring *tx[AIC880D80_MAX_TX_QUEUES];
+    u32 q;
     
-    /* Free RX buffers */
-    for (i = 0; i < priv->rx_ring_size; i++) {
-        if (priv->rx_skbs[i]) {
-            if (priv->rx_dma_addrs[i])
-                dma_unmap_single(&priv->pdev->dev, priv->rx_dma_addrs[i],
-                               AIC880D80_RX_BUFFER_SIZE, DMA_FROM_DEVICE);
-            dev_kfree_skb(priv->rx_skbs[i]);
-        }
+    /* Wait for ndo_get_stats64 readers in their RCU section before freeing */
+    memcpy(tx, priv->tx_ring, sizeof(tx));
+    WRITE_ONCE(priv->rx_ring, NULL);
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++)
+        WRITE_ONCE(priv->tx_ring[q], NULL);
+    synchronize_net();
+    
+    if (rx) {
+        aic880d80_fold_ring_stats(rx, false);
+        aic880d80_free_ring(priv, rx, DMA_FROM_DEVICE);
     }
+    aic880d80_rx_pp_destroy(priv);
     
-    /* Free TX buffers */
-    for (i = 0; i < priv->tx_ring_size; i++) {
-        if (priv->tx_skbs[i]) {
-            if (priv->tx_dma_addrs[i])
-                dma_unmap_single(&priv->pdev->dev, priv->tx_dma_addrs[i],
-                               AIC880D80_TX_BUFFER_SIZE, DMA_TO_DEVICE);
-            dev_kfree_skb(priv->tx_skbs[i]);
-        }
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++) {
+        if (!tx[q])
+            continue;
+        aic880d80_fold_ring_stats(tx[q], true);
+        aic880d80_free_ring(priv, tx[q], DMA_TO_DEVICE);
+    }
+    
+    aic880d80_pool_free(priv);
+}
+
+/* Allocate the host block the device DMAs its statistics snapshot into */
+static int aic880d80_alloc_stats_block(struct aic880d80_private *priv)
+{
+    struct aic880d80_hw_stats_block *blk;
+    
+    blk = dma_alloc_coherent(priv->dev, sizeof(*blk),
+                             &priv->stats_block_dma, GFP_KERNEL);
+    if (!blk) {
+        dev_err(priv->dev, "Failed to allocate statistics block\n");
+        return -ENOMEM;
+    }
+    
+    WRITE_ONCE(priv->stats_block, blk);
+    return 0;
+}
+
+static void aic880d80_free_stats_block(struct aic880d80_private *priv)
+{
+    struct aic880d80_hw_stats_block *blk = priv->stats_block;
+    
+    if (!blk)
+        return;
+    
+    /* Wait for stats readers in their RCU section before freeing */
+    WRITE_ONCE(priv->stats_block, NULL);
+    synchronize_net();
+    aic880d80_fold_hw_stats(priv, blk);
+    dma_free_coherent(priv->dev, sizeof(*blk), blk,
+                      priv->stats_block_dma);
+}
+
+/* Stop the TX engine and wait for outstanding descriptor fetches to finish */
+static int aic880d80_stop_tx_engine(struct aic880d80_private *priv)
+{
+    u32 val;
+    
+    aic880d80_write32(priv, AIC880D80_REG_CTRL,
+                     aic880d80_read32(priv, AIC880D80_REG_CTRL) &
+                     ~AIC880D80_CTRL_TX_ENABLE);
+    aic880d80_write32(priv, AIC880D80_REG_DMA_CTRL,
+                     aic880d80_read32(priv, AIC880D80_REG_DMA_CTRL) &
+                     ~AIC880D80_DMA_TX_ENABLE);
+    
+    return readl_poll_timeout(priv->iobase + AIC880D80_REG_STATUS, val,
+                              !(val & AIC880D80_STATUS_TX_ACTIVE),
+                              AIC880D80_TX_STOP_POLL_US,
+                              AIC880D80_TX_STOP_TIMEOUT_US);
+}
+
+/* Release every TX buffer the hardware did not complete and empty the ring */
+static void aic880d80_drain_tx_ring(struct aic880d80_private *priv,
+                                    struct aic880d80_ring *tx)
+{
+    u32 i;
+    
+    /* Reclaim whatever the hardware finished before it was stopped */
+    aic880d80_clean_tx_ring(tx);
+    
+    for (i = 0; i < tx->size; i++) {
+        struct aic880d80_buffer_info *bi = &tx->buf[i];
+        
+        tx->dma_unmaps += aic880d80_unmap_tx_buffer(priv, bi);
+        bi->report = false;
+        if (!bi->skb)
+            continue;
+        
+        dev_kfree_skb_any(bi->skb);
+        bi->skb = NULL;
+        tx->dropped++;
+    }
+    
+    memset(tx->desc, 0, sizeof(*tx->desc) * tx->size);
+    tx->head = 0;
+    tx->tail = 0;
+    tx->since_report = 0;
+}
+
+/*
+ * Reprogram one TX ring and restart the TX engine. The other rings keep
+ * their register state and resume where they were stopped.
+ */
+static void aic880d80_restart_tx_engine(struct aic880d80_private *priv,
+                                        struct aic880d80_ring *tx)
+{
+    aic880d80_program_tx_ring(priv, tx);
+    
+    aic880d80_write32(priv, AIC880D80_REG_DMA_CTRL,
+                     aic880d80_read32(priv, AIC880D80_REG_DMA_CTRL) |
+                     AIC880D80_DMA_TX_ENABLE);
+    aic880d80_write32(priv, AIC880D80_REG_CTRL,
+                     aic880d80_read32(priv, AIC880D80_REG_CTRL) |
+                     AIC880D80_CTRL_TX_ENABLE);
+}
+
+/**
+ * aic880d80_reset_tx_queue - Recover a hung TX queue in place
+ * @priv: driver private data
+ * @queue: TX queue index
+ *
+ * Stops, drains and restarts a single TX queue. The RX ring, its mapped
+ * buffers and NAPI are left untouched so receive traffic keeps flowing
+ * while the TX side recovers.
+ */
+static int aic880d80_reset_tx_queue(struct aic880d80_private *priv,
+                                    unsigned int queue)
+{
+    struct netdev_queue *txq = netdev_get_tx_queue(priv->netdev, queue);
+    struct aic880d80_ring *tx = priv->tx_ring[queue];
+    u32 int_enable;
+    ktime_t start;
+    u64 elapsed;
+    int ret;
+    
+    start = ktime_get();
+    
+    /* Stop the stack and wait for any xmit in progress on this queue */
+    __netif_tx_lock_bh(txq);
+    netif_tx_stop_queue(txq);
+    __netif_tx_unlock_bh(txq);
+    
+    /* Mask TX completions so the interrupt handler stays off the ring */
+    int_enable = aic880d80_read32(priv, AIC880D80_REG_INT_ENABLE);
+    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE,
+                     int_enable & ~(AIC880D80_INT_TX_DONE | AIC880D80_INT_TX_ERROR));
+    synchronize_irq(priv->irq);
+    
+    ret = aic880d80_stop_tx_engine(priv);
+    if (ret) {
+        /* Buffers may still be under DMA, leave the queue stopped */
+        netdev_err(priv->netdev,
+                   "TX queue %u did not go idle, interface restart required\n",
+                   queue);
+        priv->tx_reset_failures++;
+        goto out;
+    }
+    
+    aic880d80_drain_tx_ring(priv, tx);
+    aic880d80_restart_tx_engine(priv, tx);
+    netdev_tx_reset_queue(txq);
+    
+    elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+    priv->tx_queue_resets++;
+    priv->tx_recovery_last_ns = elapsed;
+    priv->tx_recovery_total_ns += elapsed;
+    if (elapsed > priv->tx_recovery_max_ns)
+        priv->tx_recovery_max_ns = elapsed;
+    
+    netdev_info(priv->netdev, "TX queue %u recovered in %llu us\n",
+                queue, div_u64(elapsed, NSEC_PER_USEC));
+    
+out:
+    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE, int_enable);
+    if (!ret)
+        netif_tx_wake_queue(txq);
+    return ret;
+}
+
+static void aic880d80_schedule_tx_reset(struct aic880d80_private *priv,
+                                        unsigned int queue)
+{
+    if (test_bit(AIC880D80_STATE_DOWN, &priv->state))
+        return;
+    
+    set_bit(queue, &priv->tx_reset_pending);
+    schedule_work(&priv->reset_work);
+}
+
+/* Reset work: recover every TX queue flagged by the watchdogs */
+static void aic880d80_reset_task(struct work_struct *work)
+{
+    struct aic880d80_private *priv = container_of(work, struct aic880d80_private,
+                                                  reset_work);
+    unsigned int queue;
+    
+    if (test_bit(AIC880D80_STATE_DOWN, &priv->state))
+        return;
+    
+    set_bit(AIC880D80_STATE_TX_RESET, &priv->state);
+    for (queue = 0; queue < priv->netdev->real_num_tx_queues; queue++) {
+        if (test_and_clear_bit(queue, &priv->tx_reset_pending))
+            aic880d80_reset_tx_queue(priv, queue);
     }
+    clear_bit(AIC880D80_STATE_TX_RESET, &priv->state);
+}
+
+/* A frame waiting for a future ETF launch time is not a stall */
+static bool aic880d80_launch_pending(struct aic880d80_private *priv,
+                                     const struct aic880d80_desc *desc,
+                                     u32 status)
+{
+    u64 launch, now;
+    
+    if (!(status & AIC880D80_DESC_LAUNCH))
+        return false;
     
-    /* Free arrays */
-    kfree(priv->rx_skbs);
-    kfree(priv->tx_skbs);
-    kfree(priv->rx_dma_addrs);
-    kfree(priv->tx_dma_addrs);
+    launch = ((u64)le32_to_cpu(desc->launch_hi) << 32) |
+             le32_to_cpu(desc->launch_lo);
+    now = ktime_get_clocktai_ns() - READ_ONCE(priv->launch_offset_ns);
+    return (s64)(launch - now) > 0;
+}
+
+/*
+ * A TX ring is hung when it has work queued, the descriptor at the tail
+ * is still owned by the hardware and the tail has not moved for
+ * AIC880D80_TX_HANG_TICKS watchdog periods. This catches stalls long
+ * before the stack watchdog, which only fires once the queue is stopped.
+ */
+static bool aic880d80_check_tx_hang(struct aic880d80_private *priv, u32 q)
+{
+    struct aic880d80_ring *tx = priv->tx_ring[q];
+    u32 tail = READ_ONCE(tx->tail);
+    struct aic880d80_desc *desc = &tx->desc[tail];
+    u32 status = le32_to_cpu(desc->status);
     
-    /* Free DMA rings */
-    if (priv->rx_ring) {
-        dma_free_coherent(&priv->pdev->dev,
-                         sizeof(struct aic880d80_desc) * priv->rx_ring_size,
-                         priv->rx_ring, priv->rx_ring_dma);
+    if (tail == READ_ONCE(tx->head) || tail != priv->tx_hang_last_tail[q] ||
+        !(status & AIC880D80_DESC_OWN) ||
+        aic880d80_launch_pending(priv, desc, status)) {
+        priv->tx_hang_last_tail[q] = tail;
+        priv->tx_hang_ticks[q] = 0;
+        return false;
     }
     
-    if (priv->tx_ring) {
-        dma_free_coherent(&priv->pdev->dev,
-                         sizeof(struct aic880d80_desc) * priv->tx_ring_size,
-                         priv->tx_ring, priv->tx_ring_dma);
+    return ++priv->tx_hang_ticks[q] >= AIC880D80_TX_HANG_TICKS;
+}
+
+static void aic880d80_watchdog_task(struct work_struct *work)
+{
+    struct aic880d80_private *priv = container_of(to_delayed_work(work),
+                                                  struct aic880d80_private,
+                                                  watchdog_work);
+    u32 q;
+    
+    if (test_bit(AIC880D80_STATE_DOWN, &priv->state))
+        return;
+    
+    for (q = 0; q < priv->num_tx_rings; q++) {
+        if (test_bit(AIC880D80_STATE_TX_RESET, &priv->state) ||
+            !aic880d80_check_tx_hang(priv, q))
+            continue;
+        netdev_warn(priv->netdev, "TX hang detected on queue %u, tail stalled at %u\n",
+                    q, priv->tx_hang_last_tail[q]);
+        priv->tx_hang_ticks[q] = 0;
+        aic880d80_schedule_tx_reset(priv, q);
     }
+    
+    /* Keep the TAI -> SYSTIME offset from drifting */
+    if (READ_ONCE(priv->tx_launch_queues))
+        aic880d80_sync_launch_clock(priv);
+    
+    schedule_delayed_work(&priv->watchdog_work, HZ);
+}
+
+static void aic880d80_tx_timeout(struct net_device *netdev, unsigned int txqueue)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    
+    priv->tx_timeouts++;
+    netdev_warn(netdev, "TX timeout on queue %u (head %u, tail %u)\n",
+                txqueue, READ_ONCE(priv->tx_ring[txqueue]->head),
+                READ_ONCE(priv->tx_ring[txqueue]->tail));
+    aic880d80_schedule_tx_reset(priv, txqueue);
+}
+
+/* Start a programmed device and pick up the initial link state */
+static void aic880d80_enable_hw(struct aic880d80_private *priv)
+{
+    aic880d80_write32(priv, AIC880D80_REG_CTRL,
+                     aic880d80_read32(priv, AIC880D80_REG_CTRL) |
+                     AIC880D80_CTRL_ENABLE | AIC880D80_CTRL_RX_ENABLE |
+                     AIC880D80_CTRL_TX_ENABLE | AIC880D80_CTRL_INT_ENABLE);
+    
+    /* Later changes arrive as link interrupts */
+    priv->link_up = false;
+    netif_carrier_off(priv->netdev);
+    aic880d80_update_link(priv);
 }
 
 /* Network device operations */
@@ -405,88 +966,991 @@ static int aic880d80_open(struct net_device *netdev)
 {
     struct aic880d80_private *priv = netdev_priv(netdev);
     int ret;
+    u32 q;
+    
+    dev_dbg(priv->dev, "Opening network interface\n");
+    
+    ret = pm_runtime_resume_and_get(priv->dev);
+    if (ret) {
+        dev_err(priv->dev, "Failed to resume device: %d\n", ret);
+        return ret;
+    }
+    aic880d80_set_queue_placement(priv, 0);
     
-    dev_dbg(&priv->pdev->dev, "Opening network interface\n");
+    INIT_WORK(&priv->reset_work, aic880d80_reset_task);
+    INIT_DELAYED_WORK(&priv->watchdog_work, aic880d80_watchdog_task);
+    priv->tx_reset_pending = 0;
+    memset(priv->tx_hang_ticks, 0, sizeof(priv->tx_hang_ticks));
     
     /* Setup DMA rings */
     ret = aic880d80_setup_rings(priv);
     if (ret)
-        return ret;
+        goto err_rings;
+    
+    ret = aic880d80_alloc_stats_block(priv);
+    if (ret)
+        goto err_stats;
     
     /* Initialize hardware */
     ret = aic880d80_hw_init(priv);
     if (ret)
         goto err_hw_init;
     
-    /* Request IRQ */
-    snprintf(priv->irq_name, sizeof(priv->irq_name), "%s-%s", 
-             DRV_NAME, netdev->name);
-    ret = request_irq(priv->pdev->irq, aic880d80_interrupt, IRQF_SHARED,
-                     priv->irq_name, priv);
-    if (ret) {
-        dev_err(&priv->pdev->dev, "Failed to request IRQ: %d\n", ret);
-        goto err_irq;
+    /* Request IRQ; the emulated engine calls the handler itself */
+    if (priv->pdev) {
+        snprintf(priv->irq_name, sizeof(priv->irq_name), "%s-%s", 
+                 DRV_NAME, netdev->name);
+        ret = request_irq(priv->pdev->irq, aic880d80_interrupt, IRQF_SHARED,
+                         priv->irq_name, priv);
+        if (ret) {
+            dev_err(priv->dev, "Failed to request IRQ: %d\n", ret);
+            goto err_irq;
+        }
+        priv->irq = priv->pdev->irq;
+        irq_set_affinity_and_hint(priv->irq, cpumask_of(priv->irq_cpu));
     }
-    priv->irq = priv->pdev->irq;
+    aic880d80_set_xps(priv);
     
     /* Enable NAPI */
     napi_enable(&priv->napi);
     
-    /* Start hardware */
-    aic880d80_write32(priv, AIC880D80_REG_CTRL,
-                     aic880d80_read32(priv, AIC880D80_REG_CTRL) |
-                     AIC880D80_CTRL_ENABLE | AIC880D80_CTRL_RX_ENABLE |
-                     AIC880D80_CTRL_TX_ENABLE | AIC880D80_CTRL_INT_ENABLE);
+    aic880d80_enable_hw(priv);
     
-    netif_start_queue(netdev);
+    aic880d80_debugfs_register(priv);
+    
+    clear_bit(AIC880D80_STATE_DOWN, &priv->state);
+    for (q = 0; q < priv->num_tx_rings; q++)
+        netdev_tx_reset_queue(netdev_get_tx_queue(netdev, q));
+    netif_tx_start_all_queues(netdev);
     
     /* Schedule watchdog */
     schedule_delayed_work(&priv->watchdog_work, HZ);
     
-    dev_info(&priv->pdev->dev, "Network interface opened\n");
+    /* Runtime idle keeps the device up for as long as the link is */
+    pm_runtime_put(priv->dev);
+    
+    dev_info(priv->dev, "Network interface opened\n");
     return 0;
 
 err_irq:
 err_hw_init:
+    aic880d80_free_stats_block(priv);
+err_stats:
     aic880d80_free_rings(priv);
+err_rings:
+    pm_runtime_put(priv->dev);
     return ret;
 }
 
 static int aic880d80_close(struct net_device *netdev)
 {
     struct aic880d80_private *priv = netdev_priv(netdev);
+    int pm_ret;
     
-    dev_dbg(&priv->pdev->dev, "Closing network interface\n");
+    dev_dbg(priv->dev, "Closing network interface\n");
     
-    /* Stop queue and NAPI */
-    netif_stop_queue(netdev);
-    napi_disable(&priv->napi);
+    /*
+     * Back to D0 from a link-down runtime suspend. If that fails the
+     * device was already quiesced by the suspend, so only the register
+     * writes are skipped and the teardown goes on.
+     */
+    pm_ret = pm_runtime_resume_and_get(priv->dev);
+    if (pm_ret)
+        dev_warn(priv->dev, "Failed to resume device: %d\n", pm_ret);
     
-    /* Cancel work queues */
+    /* Cancel work queues before the queue can be woken by a TX reset */
+    set_bit(AIC880D80_STATE_DOWN, &priv->state);
     cancel_delayed_work_sync(&priv->watchdog_work);
     cancel_work_sync(&priv->reset_work);
     
+    /* Stop queues and NAPI, unless a failed resume left them stopped */
+    if (test_and_clear_bit(AIC880D80_STATE_SUSPENDED, &priv->state)) {
+        netif_device_attach(netdev);
+    } else {
+        netif_tx_stop_all_queues(netdev);
+        napi_disable(&priv->napi);
+    }
+    
     /* Disable hardware */
-    aic880d80_write32(priv, AIC880D80_REG_CTRL, 0);
-    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE, 0);
+    if (!pm_ret) {
+        aic880d80_write32(priv, AIC880D80_REG_CTRL, 0);
+        aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE, 0);
+        aic880d80_write32(priv, AIC880D80_REG_STATS_DMA_CTRL, 0);
+    }
+    
+    aic880d80_debugfs_unregister(priv);
     
     /* Free IRQ */
     if (priv->irq) {
+        irq_update_affinity_hint(priv->irq, NULL);
         free_irq(priv->irq, priv);
         priv->irq = 0;
     }
     
     /* Free rings */
     aic880d80_free_rings(priv);
+    aic880d80_free_stats_block(priv);
+    
+    if (!pm_ret)
+        pm_runtime_put(priv->dev);
     
-    dev_info(&priv->pdev->dev, "Network interface closed\n");
+    dev_info(priv->dev, "Network interface closed\n");
     return 0;
 }
 
-/* This is a partial implementation showing the core structure.
- * The complete driver would include TX/RX functions, interrupt handler,
- * NAPI polling, ethtool support, etc.
- */
+/* Software counters plus the last device-written MAC/PHY snapshot */
+static void aic880d80_get_stats64(struct net_device *netdev,
+                                  struct rtnl_link_stats64 *stats)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    struct aic880d80_ring *rx;
+    struct aic880d80_stats hw = {};
+    u32 q;
+    
+    aic880d80_read_hw_stats(priv, &hw);
+    
+    stats->rx_packets = priv->hw_stats.rx_packets;
+    stats->tx_packets = priv->hw_stats.tx_packets;
+    stats->rx_bytes = priv->hw_stats.rx_bytes;
+    stats->tx_bytes = priv->hw_stats.tx_bytes;
+    stats->rx_dropped = priv->hw_stats.rx_dropped;
+    stats->tx_dropped = priv->hw_stats.tx_dropped;
+    
+    /* aic880d80_free_rings() waits for this with synchronize_net() */
+    rcu_read_lock();
+    rx = READ_ONCE(priv->rx_ring);
+    if (rx) {
+        stats->rx_packets += READ_ONCE(rx->packets);
+        stats->rx_bytes += READ_ONCE(rx->bytes);
+        stats->rx_dropped += READ_ONCE(rx->dropped);
+    }
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++) {
+        struct aic880d80_ring *tx = READ_ONCE(priv->tx_ring[q]);
+        
+        if (!tx)
+            continue;
+        stats->tx_packets += READ_ONCE(tx->packets);
+        stats->tx_bytes += READ_ONCE(tx->bytes);
+        stats->tx_dropped += READ_ONCE(tx->dropped);
+    }
+    rcu_read_unlock();
+    
+    stats->rx_crc_errors = hw.rx_crc_errors;
+    stats->rx_length_errors = hw.rx_length_errors;
+    stats->rx_fifo_errors = hw.rx_fifo_errors;
+    stats->rx_missed_errors = hw.rx_missed_errors;
+    stats->tx_fifo_errors = hw.tx_fifo_errors;
+    stats->tx_aborted_errors = hw.tx_aborted_errors;
+    stats->tx_carrier_errors = hw.tx_carrier_errors;
+    stats->tx_window_errors = hw.tx_window_errors;
+    
+    stats->rx_errors = priv->hw_stats.rx_errors + hw.rx_crc_errors +
+                       hw.rx_length_errors + hw.rx_fifo_errors;
+    stats->tx_errors = priv->hw_stats.tx_errors + hw.tx_fifo_errors +
+                       hw.tx_aborted_errors + hw.tx_carrier_errors +
+                       hw.tx_window_errors;
+}
+
+/* Fall back to software GSO for segments the USO engine cannot describe */
+static netdev_features_t aic880d80_features_check(struct sk_buff *skb,
+                                                  struct net_device *netdev,
+                                                  netdev_features_t features)
+{
+    if (skb_is_gso(skb) &&
+        (skb_shinfo(skb)->gso_size > FIELD_MAX(AIC880D80_DESC_SEG_MSS) ||
+         skb_transport_offset(skb) + sizeof(struct udphdr) >
+         FIELD_MAX(AIC880D80_DESC_SEG_HDRLEN)))
+        features &= ~NETIF_F_GSO_MASK;
+    
+    return features;
+}
+
+/* USO fills in the UDP checksum per segment, so it needs tx-checksumming */
+static netdev_features_t aic880d80_fix_features(struct net_device *netdev,
+                                                netdev_features_t features)
+{
+    if (!(features & NETIF_F_HW_CSUM))
+        features &= ~NETIF_F_GSO_UDP_L4;
+    
+    return features;
+}
+
+/*
+ * Point num_tc traffic classes at rings 0..num_tc-1, one ring each, and
+ * set the schedule the rings are programmed with at open.
+ */
+static int aic880d80_apply_tc(struct net_device *netdev, u8 num_tc,
+                              const u8 *weight, u32 sched)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    u32 rings = num_tc ?: 1;
+    int tc, ret;
+    
+    ret = netif_set_real_num_tx_queues(netdev, rings);
+    if (ret)
+        return ret;
+    
+    if (!num_tc) {
+        netdev_reset_tc(netdev);
+        priv->tx_launch_queues &= BIT(0);
+    } else {
+        ret = netdev_set_num_tc(netdev, num_tc);
+        if (ret)
+            return ret;
+        for (tc = 0; tc < num_tc; tc++)
+            netdev_set_tc_queue(netdev, tc, 1, tc);
+    }
+    
+    priv->num_tc = num_tc;
+    priv->num_tx_rings = rings;
+    memcpy(priv->tx_weight, weight, sizeof(priv->tx_weight));
+    priv->tx_sched = sched | ((rings - 1) << AIC880D80_TX_SCHED_RINGS_SHIFT);
+    return 0;
+}
+
+/*
+ * Map each mqprio traffic class to its own hardware TX ring (TC n -> ring
+ * n). The device drains the rings in strict priority, highest TC first,
+ * unless the channel-mode min_rate shaper is given, in which case the
+ * rates become weighted round robin weights. Changing the ring count
+ * needs the rings reallocated, so the interface has to be down.
+ */
+static int aic880d80_setup_mqprio(struct net_device *netdev,
+                                  struct tc_mqprio_qopt_offload *mqprio)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    u8 num_tc = mqprio->qopt.num_tc;
+    u8 weight[AIC880D80_MAX_TX_QUEUES];
+    u8 old_weight[AIC880D80_MAX_TX_QUEUES];
+    u8 old_num_tc = priv->num_tc;
+    u32 old_sched = priv->tx_sched & AIC880D80_TX_SCHED_WRR;
+    u32 sched = 0;
+    u64 max_rate = 0;
+    int tc, ret;
+    
+    /* Offloaded macvlans own the extra rings and the TC mapping */
+    if (priv->num_fwd) {
+        NL_SET_ERR_MSG_MOD(mqprio->extack,
+                           "mqprio unavailable while macvlans are offloaded");
+        return -EBUSY;
+    }
+    
+    /* The rings are sized at open, so a running interface keeps its mapping */
+    if (netif_running(netdev)) {
+        NL_SET_ERR_MSG_MOD(mqprio->extack,
+                           "Bring the interface down to change the TC mapping");
+        return -EBUSY;
+    }
+    
+    if (num_tc > AIC880D80_MAX_TX_QUEUES) {
+        NL_SET_ERR_MSG_FMT_MOD(mqprio->extack,
+                               "At most %u traffic classes supported",
+                               AIC880D80_MAX_TX_QUEUES);
+        return -EINVAL;
+    }
+    
+    /* Channel mode takes the queues as given, and each TC has one ring */
+    if (mqprio->mode == TC_MQPRIO_MODE_CHANNEL) {
+        for (tc = 0; tc < num_tc; tc++) {
+            if (mqprio->qopt.count[tc] != 1 ||
+                mqprio->qopt.offset[tc] != tc) {
+                NL_SET_ERR_MSG_MOD(mqprio->extack,
+                                   "Each traffic class needs queue N, count 1");
+                return -EINVAL;
+            }
+        }
+    }
+    
+    memset(weight, 1, sizeof(weight));
+    if (num_tc && mqprio->mode == TC_MQPRIO_MODE_CHANNEL &&
+        mqprio->shaper == TC_MQPRIO_SHAPER_BW_RLIMIT) {
+        if (mqprio->flags & TC_MQPRIO_F_MAX_RATE) {
+            NL_SET_ERR_MSG_MOD(mqprio->extack,
+                               "max_rate shaping is not supported");
+            return -EOPNOTSUPP;
+        }
+        if (mqprio->flags & TC_MQPRIO_F_MIN_RATE) {
+            for (tc = 0; tc < num_tc; tc++)
+                max_rate = max(max_rate, mqprio->min_rate[tc]);
+            for (tc = 0; tc < num_tc; tc++)
+                weight[tc] = max_t(u64, 1,
+                                   div64_u64(mqprio->min_rate[tc] *
+                                             AIC880D80_TX_WEIGHT_MAX,
+                                             max_rate ?: 1));
+            sched |= AIC880D80_TX_SCHED_WRR;
+        }
+    }
+    memcpy(old_weight, priv->tx_weight, sizeof(old_weight));
+    
+    ret = aic880d80_apply_tc(netdev, num_tc, weight, sched);
+    if (ret) {
+        /* Back to the previous mapping, the queue count may have changed */
+        aic880d80_apply_tc(netdev, old_num_tc, old_weight, old_sched);
+        return ret;
+    }
+    
+    /* DCB mode leaves the queue layout to us, report the one in use */
+    for (tc = 0; tc < num_tc; tc++) {
+        mqprio->qopt.count[tc] = 1;
+        mqprio->qopt.offset[tc] = tc;
+    }
+    if (num_tc)
+        mqprio->qopt.hw = TC_MQPRIO_HW_OFFLOAD_TCS;
+    return 0;
+}
+
+/*
+ * ETF offload: the ring carries skb->tstamp in the descriptor and the
+ * device holds each frame until SYSTIME reaches it, so the qdisc only
+ * has to keep frames sorted and no longer arms a timer per packet.
+ */
+static int aic880d80_setup_etf(struct net_device *netdev,
+                               struct tc_etf_qopt_offload *qopt)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    int q = qopt->queue;
+    int ret;
+    
+    if (q < 0 || q >= priv->num_tx_rings)
+        return -EINVAL;
+    
+    /* SYSTIME and TXQ_CTRL need the device out of runtime D3 */
+    ret = pm_runtime_resume_and_get(priv->dev);
+    if (ret)
+        return ret;
+    
+    if (qopt->enable) {
+        aic880d80_sync_launch_clock(priv);
+        set_bit(q, &priv->tx_launch_queues);
+    } else {
+        clear_bit(q, &priv->tx_launch_queues);
+    }
+    
+    /* Takes effect immediately on a live ring, otherwise at open */
+    if (netif_running(netdev))
+        aic880d80_write32(priv, AIC880D80_REG_TXQ(q, AIC880D80_TXQ_CTRL),
+                         qopt->enable ? AIC880D80_TXQ_CTRL_LAUNCH : 0);
+    pm_runtime_put(priv->dev);
+    
+    netdev_dbg(netdev, "Launch time %s on TX queue %d\n",
+               qopt->enable ? "enabled" : "disabled", q);
+    return 0;
+}
+
+static int aic880d80_setup_tc(struct net_device *netdev, enum tc_setup_type type,
+                              void *type_data)
+{
+    switch (type) {
+    case TC_SETUP_QDISC_MQPRIO:
+        return aic880d80_setup_mqprio(netdev, type_data);
+    case TC_SETUP_QDISC_ETF:
+        return aic880d80_setup_etf(netdev, type_data);
+    default:
+        return -EOPNOTSUPP;
+    }
+}
+
+/* Station ring q on a running interface: allocate it if need be, reset BQL */
+static int aic880d80_fwd_attach_ring(struct aic880d80_private *priv, u32 q)
+{
+    struct aic880d80_ring *tx = priv->tx_ring[q];
+    
+    /* Offload was switched on after open; the ring is not scheduled yet */
+    if (!tx) {
+        tx = aic880d80_alloc_ring(priv, priv->tx_ring_size, q);
+        if (!tx)
+            return -ENOMEM;
+        if (priv->push_base)
+            tx->push = priv->push_base + AIC880D80_PUSH_WINDOW(q);
+        aic880d80_program_tx_ring(priv, tx);
+        WRITE_ONCE(priv->tx_ring[q], tx);
+    }
+    
+    netdev_tx_reset_queue(netdev_get_tx_queue(priv->netdev, q));
+    return 0;
+}
+
+/*
+ * Take station ring q out of service on a running interface. The TX
+ * engine pauses for every ring while what the departing station left
+ * behind is dropped and ring q is reset, then resumes under @sched.
+ */
+static int aic880d80_fwd_detach_ring(struct aic880d80_private *priv, u32 q,
+                                     u32 sched)
+{
+    struct netdev_queue *txq = netdev_get_tx_queue(priv->netdev, q);
+    struct aic880d80_ring *tx = priv->tx_ring[q];
+    u32 int_enable;
+    int ret;
+    
+    __netif_tx_lock_bh(txq);
+    netif_tx_stop_queue(txq);
+    __netif_tx_unlock_bh(txq);
+    
+    /* Mask TX completions so the interrupt handler stays off the ring */
+    int_enable = aic880d80_read32(priv, AIC880D80_REG_INT_ENABLE);
+    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE,
+                     int_enable & ~(AIC880D80_INT_TX_DONE | AIC880D80_INT_TX_ERROR));
+    if (priv->irq)
+        synchronize_irq(priv->irq);
+    
+    ret = aic880d80_stop_tx_engine(priv);
+    if (ret) {
+        /* Buffers may still be under DMA, leave the ring as it is */
+        netdev_err(priv->netdev,
+                   "TX engine did not go idle, interface restart required\n");
+        priv->tx_reset_failures++;
+    } else {
+        aic880d80_drain_tx_ring(priv, tx);
+        netdev_tx_reset_queue(txq);
+        aic880d80_write32(priv, AIC880D80_REG_TX_SCHED, sched);
+        aic880d80_restart_tx_engine(priv, tx);
+    }
+    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE, int_enable);
+    return ret;
+}
+
+/*
+ * Give TX ring q to vdev, or take it back with vdev NULL. The ring count
+ * covers the highest station and the rings are served round robin, so a
+ * busy container cannot starve the others or us. A running interface
+ * keeps running: the ring is attached or detached in place, and nothing
+ * changes if attaching fails.
+ */
+static int aic880d80_fwd_set_station(struct net_device *netdev, u32 q,
+                                     struct net_device *vdev)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    bool running = netif_running(netdev);
+    u32 rings = 1, sched, i;
+    int ret;
+    
+    for (i = 1; i < AIC880D80_MAX_TX_QUEUES; i++)
+        if (i == q ? vdev : priv->fwd_station[i])
+            rings = i + 1;
+    sched = (rings > 1 ? AIC880D80_TX_SCHED_WRR : 0) |
+            ((rings - 1) << AIC880D80_TX_SCHED_RINGS_SHIFT);
+    
+    /* Back to D0 from a link-down runtime suspend for the register writes */
+    if (running) {
+        ret = pm_runtime_resume_and_get(priv->dev);
+        if (ret)
+            return ret;
+    }
+    
+    if (vdev) {
+        ret = netif_set_real_num_tx_queues(netdev, rings);
+        if (!ret && running) {
+            ret = aic880d80_fwd_attach_ring(priv, q);
+            /* Shrinking back cannot fail */
+            if (ret)
+                netif_set_real_num_tx_queues(netdev, priv->num_tx_rings);
+        }
+        if (ret)
+            goto out;
+        /* RX may steer to the station as soon as it is published */
+        WRITE_ONCE(priv->fwd_station[q], vdev);
+        WRITE_ONCE(priv->num_fwd, priv->num_fwd + 1);
+    } else {
+        /* Stop steering to the station, and wait out a poll still doing so */
+        WRITE_ONCE(priv->fwd_station[q], NULL);
+        WRITE_ONCE(priv->num_fwd, priv->num_fwd - 1);
+        synchronize_net();
+        
+        /* The station is gone either way, a failure only strands its ring */
+        ret = running ? aic880d80_fwd_detach_ring(priv, q, sched) : 0;
+    }
+    
+    WRITE_ONCE(priv->num_tx_rings, rings);
+    memset(priv->tx_weight, 1, sizeof(priv->tx_weight));
+    priv->tx_sched = sched;
+    
+    if (!vdev) {
+        netif_set_real_num_tx_queues(netdev, rings);
+    } else if (running) {
+        aic880d80_write32(priv, AIC880D80_REG_TX_SCHED, sched);
+        netif_tx_wake_queue(netdev_get_tx_queue(netdev, q));
+    }
+    
+out:
+    if (running)
+        pm_runtime_put(priv->dev);
+    return ret;
+}
+
+/*
+ * ndo_dfwd_add_station: a macvlan on top of us is opening. It gets a
+ * dedicated TX ring as its subordinate channel, while our own traffic
+ * stays on ring 0. The device has a single RX ring, so RX steering by
+ * destination address happens in the RX path. An error makes macvlan
+ * fall back to the software path.
+ */
+static void *aic880d80_fwd_add_station(struct net_device *netdev,
+                                       struct net_device *vdev)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    u32 q;
+    int ret;
+    
+    /* mqprio already maps the rings to traffic classes */
+    if (priv->num_tc)
+        return ERR_PTR(-EBUSY);
+    
+    for (q = 1; q < AIC880D80_MAX_TX_QUEUES; q++)
+        if (!priv->fwd_station[q])
+            break;
+    if (q == AIC880D80_MAX_TX_QUEUES)
+        return ERR_PTR(-EBUSY);
+    
+    /* macvlan leaves the address to us when offloaded */
+    ret = dev_uc_add(netdev, vdev->dev_addr);
+    if (ret)
+        return ERR_PTR(ret);
+    
+    if (!priv->num_fwd) {
+        ret = netdev_set_num_tc(netdev, 1);
+        if (ret)
+            goto err_tc;
+        netdev_set_tc_queue(netdev, 0, 1, 0);
+    }
+    
+    netdev_set_sb_channel(vdev, q);
+    ret = netdev_bind_sb_channel_queue(netdev, vdev, 0, 1, q);
+    if (ret)
+        goto err_bind;
+    
+    ret = aic880d80_fwd_set_station(netdev, q, vdev);
+    if (ret)
+        goto err_station;
+    
+    netdev_info(netdev, "%s offloaded to TX ring %u\n", vdev->name, q);
+    return vdev;
+
+err_station:
+    netdev_unbind_sb_channel(netdev, vdev);
+err_bind:
+    netdev_set_sb_channel(vdev, 0);
+    if (!priv->num_fwd)
+        netdev_reset_tc(netdev);
+err_tc:
+    dev_uc_del(netdev, vdev->dev_addr);
+    return ERR_PTR(ret);
+}
+
+/* ndo_dfwd_del_station: the macvlan is closing, release its ring */
+static void aic880d80_fwd_del_station(struct net_device *netdev, void *accel_priv)
+{
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    struct net_device *vdev = accel_priv;
+    int ret;
+    u32 q;
+    
+    for (q = 1; q < AIC880D80_MAX_TX_QUEUES; q++)
+        if (priv->fwd_station[q] == vdev)
+            break;
+    if (q == AIC880D80_MAX_TX_QUEUES)
+        return;
+    
+    netdev_unbind_sb_channel(netdev, vdev);
+    netdev_set_sb_channel(vdev, 0);
+    
+    /* The station is released even if its ring could not be reset */
+    ret = aic880d80_fwd_set_station(netdev, q, NULL);
+    if (ret)
+        netdev_err(netdev, "Resetting released TX ring %u failed: %d\n",
+                   q, ret);
+    
+    if (!priv->num_fwd)
+        netdev_reset_tc(netdev);
+    dev_uc_del(netdev, vdev->dev_addr);
+    netdev_info(netdev, "%s released TX ring %u\n", vdev->name, q);
+}
+
+/* Network device operations structure */
+static const struct net_device_ops aic880d80_netdev_ops = {
+    .ndo_open = aic880d80_open,
+    .ndo_stop = aic880d80_close,
+    .ndo_start_xmit = aic880d80_start_xmit,
+    .ndo_tx_timeout = aic880d80_tx_timeout,
+    .ndo_get_stats64 = aic880d80_get_stats64,
+    .ndo_set_rx_mode = aic880d80_set_rx_mode,
+    .ndo_setup_tc = aic880d80_setup_tc,
+    .ndo_dfwd_add_station = aic880d80_fwd_add_station,
+    .ndo_dfwd_del_station = aic880d80_fwd_del_station,
+    .ndo_fix_features = aic880d80_fix_features,
+    .ndo_features_check = aic880d80_features_check,
+    .ndo_validate_addr = eth_validate_addr,
+};
+
+/**
+ * aic880d80_probe_common - Bus-independent part of probe
+ * @dev: device to allocate against and use for DMA
+ * @pdev: PCI device, NULL for the emulated backend
+ * @iobase: mapped register space
+ * @emu: emulated backend, NULL on hardware
+ *
+ * Everything after the registers are mapped and DMA is configured:
+ * netdev allocation, configuration, reset and registration.
+ */
+int aic880d80_probe_common(struct device *dev, struct pci_dev *pdev,
+                           void __iomem *iobase, struct aic880d80_emu *emu)
+{
+    struct aic880d80_private *priv;
+    struct net_device *netdev;
+    u8 mac[ETH_ALEN];
+    int ret;
+    
+    netdev = devm_alloc_etherdev_mqs(dev, sizeof(*priv),
+                                     AIC880D80_MAX_TX_QUEUES, 1);
+    if (!netdev)
+        return -ENOMEM;
+    SET_NETDEV_DEV(netdev, dev);
+    dev_set_drvdata(dev, netdev);
+    
+    priv = netdev_priv(netdev);
+    priv->netdev = netdev;
+    priv->pdev = pdev;
+    priv->dev = dev;
+    priv->iobase = iobase;
+    priv->emu = emu;
+    
+    /* Optional low-latency TX push windows, mapped write-combining */
+    if (pdev && (pci_resource_flags(pdev, AIC880D80_PUSH_BAR) & IORESOURCE_MEM) &&
+        pci_resource_len(pdev, AIC880D80_PUSH_BAR) >=
+        AIC880D80_MAX_TX_QUEUES * AIC880D80_PUSH_STRIDE)
+        priv->push_base = devm_ioremap_wc(dev,
+                                          pci_resource_start(pdev, AIC880D80_PUSH_BAR),
+                                          AIC880D80_MAX_TX_QUEUES *
+                                          AIC880D80_PUSH_STRIDE);
+    priv->arm64_coherent_dma =
+        device_get_dma_attr(dev) == DEV_DMA_COHERENT;
+    priv->msg_enable = netif_msg_init(debug, NETIF_MSG_DRV | NETIF_MSG_PROBE |
+                                             NETIF_MSG_LINK);
+    priv->max_frame_size = AIC880D80_MAX_FRAME_SIZE;
+    priv->neon_available = aic880d80_neon_detect();
+    priv->rx_copybreak = rx_copybreak;
+    priv->tx_copybreak = min_t(u32, tx_copybreak, AIC880D80_TX_BUFFER_SIZE);
+    priv->tx_int_desc = AIC880D80_TX_INT_DESC;
+    
+    /* One TX ring until mqprio asks for more */
+    priv->num_tx_rings = 1;
+    memset(priv->tx_weight, 1, sizeof(priv->tx_weight));
+    netif_set_real_num_tx_queues(netdev, 1);
+    set_bit(AIC880D80_STATE_DOWN, &priv->state);
+    
+    aic880d80_load_config(priv);
+    
+    ret = aic880d80_hw_reset(priv);
+    if (ret)
+        return ret;
+    
+    if (calibrate_dma)
+        aic880d80_calibrate_dma(priv);
+    
+    netdev->netdev_ops = &aic880d80_netdev_ops;
+    aic880d80_set_ethtool_ops(netdev);
+    netdev->watchdog_timeo = AIC880D80_TX_TIMEOUT;
+    
+    /* Secondary unicast addresses go to the perfect table or UC hash */
+    netdev->priv_flags |= IFF_UNICAST_FLT;
+    
+    /*
+     * The device has no checksum engine: with tx-checksumming on the
+     * driver computes checksums on the CPU, so it is opt-in. L2
+     * forwarding offload is opt-in too, it takes the extra TX rings.
+     */
+    netdev->hw_features = NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_GSO_UDP_L4 |
+                          NETIF_F_HW_TC | NETIF_F_HW_L2FW_DOFFLOAD;
+    netdev->features |= NETIF_F_SG | NETIF_F_HW_TC;
+    
+    /* The emulated engine does not segment */
+    if (emu)
+        netdev->hw_features &= ~NETIF_F_GSO_UDP_L4;
+    
+    netdev->min_mtu = ETH_MIN_MTU;
+    netdev->max_mtu = priv->rx_buf_size - ETH_HLEN - ETH_FCS_LEN;
+    
+    netif_napi_add(netdev, &priv->napi, aic880d80_napi_poll);
+    spin_lock_init(&priv->int_mask_lock);
+    
+    aic880d80_read_mac_address(priv, mac);
+    if (is_valid_ether_addr(mac)) {
+        eth_hw_addr_set(netdev, mac);
+    } else {
+        dev_warn(dev, "Invalid MAC address %pM, using random\n", mac);
+        eth_hw_addr_random(netdev);
+    }
+    
+    ret = aic880d80_rx_shrinker_init(priv);
+    if (ret)
+        goto err_register;
+    
+    ret = register_netdev(netdev);
+    if (ret) {
+        dev_err(dev, "Failed to register netdev: %d\n", ret);
+        goto err_register;
+    }
+    netif_carrier_off(netdev);
+    
+    /* Default only; the "threaded" sysfs attribute overrides it at runtime */
+    if (napi_threaded) {
+        ret = dev_set_threaded(netdev, true);
+        if (ret)
+            netdev_warn(netdev, "Threaded NAPI unavailable: %d\n", ret);
+    }
+    
+    netif_info(priv, probe, netdev, "AIC 880d80 at %s, MAC %pM\n",
+               dev_name(dev), netdev->dev_addr);
+    return 0;
+
+err_register:
+    if (priv->rx_shrinker)
+        aic880d80_rx_shrinker_exit(priv);
+    netif_napi_del(&priv->napi);
+    return ret;
+}
+
+/* Undo aic880d80_probe_common() */
+void aic880d80_remove_common(struct device *dev)
+{
+    struct net_device *netdev = dev_get_drvdata(dev);
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    
+    unregister_netdev(netdev);
+    aic880d80_rx_shrinker_exit(priv);
+    netif_napi_del(&priv->napi);
+}
+
+static int aic880d80_probe(struct pci_dev *pdev, const struct pci_device_id *id)
+{
+    int ret;
+    
+    ret = pcim_enable_device(pdev);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to enable PCI device: %d\n", ret);
+        return ret;
+    }
+    
+    ret = pcim_iomap_regions(pdev, BIT(0), DRV_NAME);
+    if (ret) {
+        dev_err(&pdev->dev, "Failed to map BAR0: %d\n", ret);
+        return ret;
+    }
+    pci_set_master(pdev);
+    
+    ret = dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(64));
+    if (ret)
+        ret = dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(32));
+    if (ret) {
+        dev_err(&pdev->dev, "No usable DMA configuration\n");
+        return ret;
+    }
+    
+    ret = aic880d80_probe_common(&pdev->dev, pdev, pcim_iomap_table(pdev)[0],
+                                 NULL);
+    if (ret)
+        return ret;
+    
+    /*
+     * Runtime D3 is only entered with the link down, so it needs a device
+     * that can signal PME when the link comes back.
+     */
+    if (pci_dev_run_wake(pdev))
+        pm_runtime_put(&pdev->dev);
+    return 0;
+}
+
+static void aic880d80_remove(struct pci_dev *pdev)
+{
+    if (pci_dev_run_wake(pdev))
+        pm_runtime_get_noresume(&pdev->dev);
+    aic880d80_remove_common(&pdev->dev);
+}
+
+/*
+ * Quiesce an open interface for D3 without tearing it down. The rings,
+ * the RX buffers and their DMA mappings stay allocated; only TX frames
+ * still in flight are dropped, as the device loses them anyway.
+ */
+static void aic880d80_net_suspend(struct aic880d80_private *priv)
+{
+    struct net_device *netdev = priv->netdev;
+    u32 q;
+    
+    if (test_and_set_bit(AIC880D80_STATE_SUSPENDED, &priv->state))
+        return;
+    
+    /* Detach and wait out any xmit still writing descriptors */
+    netif_device_detach(netdev);
+    netif_tx_disable(netdev);
+    set_bit(AIC880D80_STATE_DOWN, &priv->state);
+    cancel_delayed_work_sync(&priv->watchdog_work);
+    cancel_work_sync(&priv->reset_work);
+    
+    aic880d80_write32(priv, AIC880D80_REG_INT_ENABLE, 0);
+    if (priv->irq)
+        synchronize_irq(priv->irq);
+    napi_disable(&priv->napi);
+    
+    if (aic880d80_stop_tx_engine(priv))
+        netdev_warn(netdev, "TX engine did not go idle before suspend\n");
+    aic880d80_write32(priv, AIC880D80_REG_CTRL, 0);
+    aic880d80_write32(priv, AIC880D80_REG_DMA_CTRL, 0);
+    aic880d80_write32(priv, AIC880D80_REG_STATS_DMA_CTRL, 0);
+    
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES; q++) {
+        if (!priv->tx_ring[q])
+            continue;
+        aic880d80_drain_tx_ring(priv, priv->tx_ring[q]);
+        netdev_tx_reset_queue(netdev_get_tx_queue(netdev, q));
+    }
+    aic880d80_rx_rearm(priv);
+    
+    priv->pm_suspends++;
+}
+
+/*
+ * Undo aic880d80_net_suspend(): reset the device and reprogram register
+ * state only. hw_init() points the device at the kept rings, with RX
+ * resuming at the first posted buffer. Time to the first received frame
+ * is recorded by the RX path.
+ */
+static int aic880d80_net_resume(struct aic880d80_private *priv)
+{
+    struct net_device *netdev = priv->netdev;
+    u64 start = ktime_get_ns();
+    int ret;
+    
+    if (!test_bit(AIC880D80_STATE_SUSPENDED, &priv->state))
+        return 0;
+    
+    ret = aic880d80_hw_init(priv);
+    if (ret) {
+        netdev_err(netdev, "Resume failed: %d\n", ret);
+        return ret;
+    }
+    
+    napi_enable(&priv->napi);
+    aic880d80_enable_hw(priv);
+    
+    clear_bit(AIC880D80_STATE_DOWN, &priv->state);
+    clear_bit(AIC880D80_STATE_SUSPENDED, &priv->state);
+    WRITE_ONCE(priv->pm_resume_start_ns, start);
+    netif_device_attach(netdev);
+    schedule_delayed_work(&priv->watchdog_work, HZ);
+    
+    priv->pm_resume_ns = ktime_get_ns() - start;
+    netdev_dbg(netdev, "Resumed in %llu us\n",
+               div_u64(priv->pm_resume_ns, NSEC_PER_USEC));
+    return 0;
+}
+
+static int aic880d80_suspend(struct device *dev)
+{
+    struct net_device *netdev = dev_get_drvdata(dev);
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    
+    rtnl_lock();
+    if (netif_running(netdev))
+        aic880d80_net_suspend(priv);
+    rtnl_unlock();
+    return 0;
+}
+
+static int aic880d80_resume(struct device *dev)
+{
+    struct net_device *netdev = dev_get_drvdata(dev);
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    int ret;
+    
+    rtnl_lock();
+    ret = aic880d80_net_resume(priv);
+    rtnl_unlock();
+    return ret;
+}
+
+/*
+ * Runtime PM must not take the RTNL: open() and close() resume the device
+ * while holding it. They also hold a usage reference throughout, so the
+ * interface cannot change state under these callbacks.
+ */
+static int aic880d80_runtime_suspend(struct device *dev)
+{
+    struct net_device *netdev = dev_get_drvdata(dev);
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    
+    if (netif_running(netdev))
+        aic880d80_net_suspend(priv);
+    return 0;
+}
+
+static int aic880d80_runtime_resume(struct device *dev)
+{
+    struct net_device *netdev = dev_get_drvdata(dev);
+    struct aic880d80_private *priv = netdev_priv(netdev);
+    
+    return aic880d80_net_resume(priv);
+}
+
+/* Stay up while there is a link; otherwise suspend after a grace period */
+static int aic880d80_runtime_idle(struct device *dev)
+{
+    struct net_device *netdev = dev_get_drvdata(dev);
+    
+    if (!netif_running(netdev) || !netif_carrier_ok(netdev))
+        pm_schedule_suspend(dev, AIC880D80_RUNTIME_SUSPEND_MS);
+    return -EBUSY;
+}
+
+/* Power management operations, shared with the emulated backend */
+const struct dev_pm_ops aic880d80_pm_ops = {
+    SYSTEM_SLEEP_PM_OPS(aic880d80_suspend, aic880d80_resume)
+    RUNTIME_PM_OPS(aic880d80_runtime_suspend, aic880d80_runtime_resume,
+                   aic880d80_runtime_idle)
+};
+
+/* PCI driver structure */
+static struct pci_driver aic880d80_driver = {
+    .name = DRV_NAME,
+    .id_table = aic880d80_pci_tbl,
+    .probe = aic880d80_probe,
+    .remove = aic880d80_remove,
+    .driver.pm = pm_ptr(&aic880d80_pm_ops),
+};
+
+static int __init aic880d80_init_module(void)
+{
+    int ret;
+    
+    aic880d80_debugfs_init();
+    
+    ret = pci_register_driver(&aic880d80_driver);
+    if (ret)
+        goto err_pci;
+    
+    if (emulate) {
+        ret = aic880d80_emu_register();
+        if (ret)
+            goto err_emu;
+    }
+    return 0;
+
+err_emu:
+    pci_unregister_driver(&aic880d80_driver);
+err_pci:
+    aic880d80_debugfs_exit();
+    return ret;
+}
+module_init(aic880d80_init_module);
+
+static void __exit aic880d80_exit_module(void)
+{
+    if (emulate)
+        aic880d80_emu_unregister();
+    pci_unregister_driver(&aic880d80_driver);
+    aic880d80_debugfs_exit();
+}
+module_exit(aic880d80_exit_module);
 
 MODULE_AUTHOR("Zero Day Security Research");
 MODULE_DESCRIPTION(DRV_DESCRIPTION);
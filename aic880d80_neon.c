@@ -0,0 +1,209 @@
+/*
+ * aic880d80_neon.c - NEON-accelerated software fallbacks for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frame copies (RX copybreak) and the Internet checksum for packets the
+ * hardware cannot checksum run on NEON when the CPU has it and the
+ * buffer is long enough to pay for the FPSIMD state save. Everything
+ * else uses the generic kernel routines.
+ */
+#include "aic880d80.h"
+#include <linux/skbuff.h>
+#include <linux/ktime.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <net/checksum.h>
+#ifdef AIC880D80_HAVE_NEON
+#include <asm/cpufeature.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#endif
+
+bool aic880d80_neon_detect(void)
+{
+#ifdef AIC880D80_HAVE_NEON
+    return cpu_have_named_feature(ASIMD);
+#else
+    return false;
+#endif
+}
+
+static bool aic880d80_use_neon(const struct aic880d80_private *priv,
+                               unsigned int len)
+{
+#ifdef AIC880D80_HAVE_NEON
+    return priv->neon_available && len >= AIC880D80_NEON_MIN_LEN &&
+           may_use_simd();
+#else
+    return false;
+#endif
+}
+
+void aic880d80_copy(const struct aic880d80_private *priv, void *dst,
+                    const void *src, unsigned int len)
+{
+#ifdef AIC880D80_HAVE_NEON
+    if (aic880d80_use_neon(priv, len)) {
+        kernel_neon_begin();
+        aic880d80_neon_copy(dst, src, len);
+        kernel_neon_end();
+        return;
+    }
+#endif
+    memcpy(dst, src, len);
+}
+
+__wsum aic880d80_csum(const struct aic880d80_private *priv, const void *buf,
+                      unsigned int len, __wsum sum)
+{
+#ifdef AIC880D80_HAVE_NEON
+    /* The kernel sums native-endian words; ours assumes little endian */
+    if (IS_ENABLED(CONFIG_CPU_LITTLE_ENDIAN) && aic880d80_use_neon(priv, len)) {
+        kernel_neon_begin();
+        sum = aic880d80_neon_csum(buf, len, sum);
+        kernel_neon_end();
+        return sum;
+    }
+#endif
+    return csum_partial(buf, len, sum);
+}
+
+/*
+ * Resolve CHECKSUM_PARTIAL in the driver. The device has no checksum
+ * engine, so this covers plain and tunnelled frames alike. Non-linear
+ * skbs fall back to skb_checksum_help().
+ */
+int aic880d80_tx_csum(struct aic880d80_private *priv, struct sk_buff *skb)
+{
+    unsigned int start, offset;
+    __wsum csum;
+    int ret;
+
+    if (skb->ip_summed != CHECKSUM_PARTIAL)
+        return 0;
+
+    if (skb_is_nonlinear(skb))
+        return skb_checksum_help(skb);
+
+    start = skb_checksum_start_offset(skb);
+    offset = start + skb->csum_offset;
+    if (WARN_ON_ONCE(offset + sizeof(__sum16) > skb_headlen(skb)))
+        return -EINVAL;
+
+    ret = skb_ensure_writable(skb, offset + sizeof(__sum16));
+    if (ret)
+        return ret;
+
+    csum = aic880d80_csum(priv, skb->data + start, skb->len - start, 0);
+    *(__sum16 *)(skb->data + offset) = csum_fold(csum) ?: CSUM_MANGLED_0;
+    skb->ip_summed = CHECKSUM_NONE;
+    priv->tx_sw_csum++;
+    return 0;
+}
+
+/*
+ * Microbenchmark, run by reading debugfs "neon_bench": ns per call of the
+ * generic memcpy()/csum_partial() against the NEON kernels (including
+ * kernel_neon_begin/end) for typical packet sizes.
+ */
+#define AIC880D80_BENCH_ITERS   10000
+
+static const unsigned int aic880d80_bench_sizes[] = {
+    64, 128, 256, 512, 1024, 1514, 4096, 9000,
+};
+
+#ifdef AIC880D80_HAVE_NEON
+static u64 aic880d80_bench_copy(void *dst, const void *src, unsigned int len,
+                                bool neon)
+{
+    ktime_t start = ktime_get();
+    int i;
+
+    for (i = 0; i < AIC880D80_BENCH_ITERS; i++) {
+        if (neon) {
+            kernel_neon_begin();
+            aic880d80_neon_copy(dst, src, len);
+            kernel_neon_end();
+        } else {
+            memcpy(dst, src, len);
+        }
+        barrier();
+    }
+    return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static u64 aic880d80_bench_csum(const void *buf, unsigned int len, bool neon,
+                                __sum16 *res)
+{
+    ktime_t start = ktime_get();
+    __wsum sum = 0;
+    int i;
+
+    for (i = 0; i < AIC880D80_BENCH_ITERS; i++) {
+        if (neon) {
+            kernel_neon_begin();
+            sum = aic880d80_neon_csum(buf, len, 0);
+            kernel_neon_end();
+        } else {
+            sum = csum_partial(buf, len, 0);
+        }
+        OPTIMIZER_HIDE_VAR(sum);
+    }
+    *res = csum_fold(sum);
+    return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+#endif
+
+void aic880d80_neon_bench(struct aic880d80_private *priv, struct seq_file *s)
+{
+#ifdef AIC880D80_HAVE_NEON
+    unsigned int max = aic880d80_bench_sizes[ARRAY_SIZE(aic880d80_bench_sizes) - 1];
+    u8 *src, *dst;
+    int i;
+
+    if (!priv->neon_available || !may_use_simd()) {
+        seq_puts(s, "NEON not available\n");
+        return;
+    }
+
+    /* Odd offset so unaligned heads are part of the measurement */
+    src = kmalloc(max + 1, GFP_KERNEL);
+    dst = kmalloc(max + 1, GFP_KERNEL);
+    if (!src || !dst)
+        goto out;
+    get_random_bytes(src, max + 1);
+
+    seq_printf(s, "%u iterations, ns/call\n", AIC880D80_BENCH_ITERS);
+    seq_puts(s, "size   memcpy  neon_copy  csum_partial  neon_csum  csum_match\n");
+
+    for (i = 0; i < ARRAY_SIZE(aic880d80_bench_sizes); i++) {
+        unsigned int len = aic880d80_bench_sizes[i];
+        __sum16 ref, neon;
+        u64 t_memcpy, t_ncopy, t_csum, t_ncsum;
+
+        t_memcpy = aic880d80_bench_copy(dst, src + 1, len, false);
+        t_ncopy = aic880d80_bench_copy(dst, src + 1, len, true);
+        t_csum = aic880d80_bench_csum(src + 1, len, false, &ref);
+        t_ncsum = aic880d80_bench_csum(src + 1, len, true, &neon);
+
+        seq_printf(s, "%-6u %-7llu %-10llu %-13llu %-10llu %s\n", len,
+                   div_u64(t_memcpy, AIC880D80_BENCH_ITERS),
+                   div_u64(t_ncopy, AIC880D80_BENCH_ITERS),
+                   div_u64(t_csum, AIC880D80_BENCH_ITERS),
+                   div_u64(t_ncsum, AIC880D80_BENCH_ITERS),
+                   ref == neon ? "yes" : "NO");
+        cond_resched();
+    }
+out:
+    kfree(dst);
+    kfree(src);
+#else
+    seq_puts(s, "NEON support not built\n");
+#endif
+}
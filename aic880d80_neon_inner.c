@@ -0,0 +1,76 @@
+/*
+ * aic880d80_neon_inner.c - NEON copy and checksum kernels for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This unit is built with FPU flags and must not call back into the rest
+ * of the kernel; callers wrap it in kernel_neon_begin()/kernel_neon_end().
+ */
+#include "aic880d80.h"
+#include <asm/neon-intrinsics.h>
+
+void aic880d80_neon_copy(void *dst, const void *src, unsigned int len)
+{
+    const u8 *s = src;
+    u8 *d = dst;
+
+    for (; len >= 64; len -= 64, s += 64, d += 64) {
+        uint8x16_t a = vld1q_u8(s);
+        uint8x16_t b = vld1q_u8(s + 16);
+        uint8x16_t c = vld1q_u8(s + 32);
+        uint8x16_t e = vld1q_u8(s + 48);
+
+        vst1q_u8(d, a);
+        vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c);
+        vst1q_u8(d + 48, e);
+    }
+    for (; len >= 16; len -= 16, s += 16, d += 16)
+        vst1q_u8(d, vld1q_u8(s));
+    while (len--)
+        *d++ = *s++;
+}
+
+/*
+ * One's complement sum of little-endian 16-bit words starting at buf[0],
+ * folded to 32 bits and added to @sum. Pairwise widening adds keep the
+ * 64-bit lanes from ever overflowing for any skb-sized buffer. The 32-bit
+ * result may differ from csum_partial()'s but folds to the same checksum.
+ */
+__wsum aic880d80_neon_csum(const void *buf, unsigned int len, __wsum sum)
+{
+    uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+    const u8 *p = buf;
+    u64 total;
+
+    for (; len >= 32; len -= 32, p += 32) {
+        uint16x8_t a = vreinterpretq_u16_u8(vld1q_u8(p));
+        uint16x8_t b = vreinterpretq_u16_u8(vld1q_u8(p + 16));
+
+        acc0 = vpadalq_u32(acc0, vpaddlq_u16(a));
+        acc1 = vpadalq_u32(acc1, vpaddlq_u16(b));
+    }
+    if (len >= 16) {
+        acc0 = vpadalq_u32(acc0, vpaddlq_u16(vreinterpretq_u16_u8(vld1q_u8(p))));
+        len -= 16;
+        p += 16;
+    }
+
+    acc0 = vaddq_u64(acc0, acc1);
+    total = vgetq_lane_u64(acc0, 0) + vgetq_lane_u64(acc0, 1);
+
+    for (; len >= 2; len -= 2, p += 2)
+        total += p[0] | (p[1] << 8);
+    if (len)
+        total += p[0];
+
+    total += (__force u32)sum;
+    total = (total & 0xffffffff) + (total >> 32);
+    total = (total & 0xffffffff) + (total >> 32);
+    return (__force __wsum)(u32)total;
+}
@@ -0,0 +1,173 @@
+/*
+ * aic880d80_pool.c - Pre-mapped TX bounce pool for AIC 880d80
+ *
+ * Copyright (C) 2025 Zero Day Security Research
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#include "aic880d80.h"
+#include <linux/dma-mapping.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/sizes.h>
+
+/*
+ * Behind an IOMMU every dma_map_single() allocates an IOVA and every
+ * unmap invalidates the IOTLB, and thousands of small mappings thrash
+ * the IOTLB on top of that. In pool mode RX runs on a page_pool (see
+ * aic880d80_rx.c) and every TX slot gets a fixed tx_copybreak bounce
+ * buffer carved out of a few large chunks, preferably 2 MiB so the SMMU
+ * can back each with a single block entry, mapped once when the rings
+ * are set up and unmapped when they are freed.
+ *
+ * TX frames up to tx_copybreak are copied in; larger ones are still
+ * mapped per packet. The bounce slots are small, belong to one
+ * descriptor each and never leave the ring, so a page_pool's per-page
+ * mapping and recycling would only waste memory here.
+ */
+#define AIC880D80_POOL_MAX_CHUNKS   64
+#define AIC880D80_POOL_MIN_ORDER    PAGE_ALLOC_COSTLY_ORDER
+
+struct aic880d80_pool_chunk {
+    struct page *page;
+    dma_addr_t dma;
+    unsigned int order;
+};
+
+struct aic880d80_pool {
+    struct aic880d80_pool_chunk chunk[AIC880D80_POOL_MAX_CHUNKS];
+    u32 nr_chunks;
+    unsigned int order;     /* Next chunk, lowered when an allocation fails */
+    size_t used;            /* Bytes carved from the last chunk */
+};
+
+/* Map one more chunk, from the largest order the allocator still grants */
+static struct aic880d80_pool_chunk *aic880d80_pool_grow(struct aic880d80_private *priv,
+                                                        struct aic880d80_pool *pool,
+                                                        unsigned int min_order)
+{
+    struct aic880d80_pool_chunk *chunk;
+    struct page *page;
+    unsigned int order;
+    dma_addr_t dma;
+
+    if (pool->nr_chunks == AIC880D80_POOL_MAX_CHUNKS)
+        return NULL;
+
+    for (order = pool->order; ; order--) {
+        page = alloc_pages_node(priv->ring_node, GFP_KERNEL | __GFP_COMP |
+                                __GFP_NOWARN | __GFP_NORETRY, order);
+        if (page || order <= min_order)
+            break;
+    }
+    if (!page)
+        return NULL;
+
+    dma = dma_map_page(priv->dev, page, 0, PAGE_SIZE << order,
+                       DMA_TO_DEVICE);
+    if (dma_mapping_error(priv->dev, dma)) {
+        __free_pages(page, order);
+        return NULL;
+    }
+
+    chunk = &pool->chunk[pool->nr_chunks++];
+    chunk->page = page;
+    chunk->dma = dma;
+    chunk->order = order;
+    pool->order = order;
+    pool->used = 0;
+    priv->pool_chunk_maps++;
+    return chunk;
+}
+
+/* Bump-allocate one buffer; buffers never straddle chunks or share lines */
+static int aic880d80_pool_carve(struct aic880d80_private *priv,
+                                struct aic880d80_pool *pool, u32 size,
+                                struct aic880d80_buffer_info *bi)
+{
+    struct aic880d80_pool_chunk *chunk = NULL;
+
+    size = ALIGN(size, dma_get_cache_alignment());
+    if (pool->nr_chunks)
+        chunk = &pool->chunk[pool->nr_chunks - 1];
+    if (!chunk || pool->used + size > PAGE_SIZE << chunk->order) {
+        chunk = aic880d80_pool_grow(priv, pool,
+                                    max_t(unsigned int, get_order(size),
+                                          AIC880D80_POOL_MIN_ORDER));
+        if (!chunk)
+            return -ENOMEM;
+    }
+
+    bi->pool_va = page_address(chunk->page) + pool->used;
+    bi->pool_dma = chunk->dma + pool->used;
+    pool->used += size;
+    return 0;
+}
+
+static void aic880d80_pool_clear_ring(struct aic880d80_ring *ring)
+{
+    u32 i;
+
+    for (i = 0; i < ring->size; i++)
+        ring->buf[i].pool_va = NULL;
+}
+
+/**
+ * aic880d80_pool_init - Map the pool and give every TX slot its bounce buffer
+ * @priv: driver private data
+ * @tx: the TX rings, NULL past the last one allocated
+ *
+ * On failure nothing is left mapped and the rings are untouched, so the
+ * caller can carry on with per-packet mappings.
+ */
+int aic880d80_pool_init(struct aic880d80_private *priv,
+                        struct aic880d80_ring *const *tx)
+{
+    struct aic880d80_pool *pool;
+    u32 i, q;
+
+    pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, priv->ring_node);
+    if (!pool)
+        return -ENOMEM;
+    pool->order = min_t(unsigned int, get_order(SZ_2M), MAX_PAGE_ORDER);
+    priv->pool = pool;
+
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES && tx[q]; q++)
+        for (i = 0; i < tx[q]->size; i++)
+            if (aic880d80_pool_carve(priv, pool, priv->tx_copybreak,
+                                     &tx[q]->buf[i]))
+                goto err;
+
+    netdev_dbg(priv->netdev, "DMA pool: %u chunks of order %u\n",
+               pool->nr_chunks, pool->order);
+    return 0;
+
+err:
+    for (q = 0; q < AIC880D80_MAX_TX_QUEUES && tx[q]; q++)
+        aic880d80_pool_clear_ring(tx[q]);
+    aic880d80_pool_free(priv);
+    return -ENOMEM;
+}
+
+/* Unmap and free the chunks; the rings using them must be gone already */
+void aic880d80_pool_free(struct aic880d80_private *priv)
+{
+    struct aic880d80_pool *pool = priv->pool;
+    u32 i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->nr_chunks; i++) {
+        struct aic880d80_pool_chunk *chunk = &pool->chunk[i];
+
+        dma_unmap_page(priv->dev, chunk->dma, PAGE_SIZE << chunk->order,
+                       DMA_TO_DEVICE);
+        __free_pages(chunk->page, chunk->order);
+    }
+    WRITE_ONCE(priv->pool, NULL);
+    kfree(pool);
+}
@@ -1,50 +1,696 @@
 /*
  * aic880d80_rx.c - RX skeleton for AIC 880d80
+ *
+ * In striding mode (rx_mprq) each descriptor posts a 32 KiB buffer and
+ * the device packs frames into its strides, reporting them through the
+ * completion queue (see AIC880D80_REG_RX_MPRQ). Small frames are copied
+ * out, larger ones get their headers copied and the payload attached as
+ * a page fragment. A buffer is reposted once the device closes it: in
+ * place if no skb still holds one of its strides, else with a new page.
+ * When new pages cannot be had and the ring drops below the low
+ * watermark, every frame is copied until it recovers, so the buffers
+ * left keep coming back in place. At 64-byte frames that is one
+ * descriptor and doorbell per hundred-odd frames instead of per frame.
+ *
+ * Otherwise each descriptor posts one frame buffer: an skb mapped per
+ * buffer, or in DMA pool mode a page from a page_pool. The pool maps its
+ * pages once and gets them back when the stack frees the skb built on
+ * them, so neither the IOMMU nor a copy is in the way.
  */
 #include "aic880d80.h"
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/shrinker.h>
+#include <linux/timekeeping.h>
+#include <linux/etherdevice.h>
+#include <linux/if_macvlan.h>
+#include <linux/mm.h>
+#include <net/page_pool/helpers.h>
 
 
+/*
+ * Allocate an RX skb on the queue's NUMA node rather than on whichever
+ * node the calling CPU happens to sit on.
+ */
+static struct sk_buff *aic880d80_alloc_rx_skb(struct aic880d80_private *priv,
+                                              gfp_t gfp)
+{
+    struct sk_buff *skb;
+
+    skb = __alloc_skb(priv->rx_buf_size + AIC880D80_RX_HEADROOM, gfp, 0,
+                      priv->ring_node);
+    if (!skb)
+        return NULL;
+
+    skb_reserve(skb, AIC880D80_RX_HEADROOM);
+    skb->dev = priv->netdev;
+    return skb;
+}
+
+
+/* Striding RX: map a fresh AIC880D80_MPRQ_BUF_SIZE buffer into @bi */
+static int aic880d80_rx_mprq_alloc(struct aic880d80_private *priv,
+                                   struct aic880d80_buffer_info *bi, gfp_t gfp)
+{
+    struct page *page;
+    dma_addr_t dma;
+
+    page = alloc_pages_node(priv->ring_node, gfp | __GFP_COMP | __GFP_NOWARN,
+                            AIC880D80_MPRQ_BUF_ORDER);
+    if (!page)
+        return -ENOMEM;
+
+    dma = dma_map_page(priv->dev, page, 0, AIC880D80_MPRQ_BUF_SIZE,
+                       DMA_FROM_DEVICE);
+    if (dma_mapping_error(priv->dev, dma)) {
+        __free_pages(page, AIC880D80_MPRQ_BUF_ORDER);
+        return -ENOMEM;
+    }
+
+    bi->page = page;
+    bi->dma = dma;
+    bi->len = AIC880D80_MPRQ_BUF_SIZE;
+    priv->rx_dma_maps++;
+    return 0;
+}
+
+/*
+ * Drop the driver's reference; skbs may still hold strides. Every stride
+ * handed out was synced for the CPU already.
+ */
+static void aic880d80_rx_mprq_free(struct aic880d80_private *priv,
+                                   struct aic880d80_buffer_info *bi)
+{
+    dma_unmap_page_attrs(priv->dev, bi->dma, bi->len, DMA_FROM_DEVICE,
+                         DMA_ATTR_SKIP_CPU_SYNC);
+    put_page(bi->page);
+    bi->page = NULL;
+    bi->len = 0;
+    priv->rx_dma_unmaps++;
+}
+
+/*
+ * One page per frame: the headroom, rx_buf_size for the device and the
+ * skb_shared_info napi_build_skb() puts at the end. Only the device's
+ * part is synced back when a page is recycled.
+ */
+int aic880d80_rx_pp_create(struct aic880d80_private *priv,
+                           struct aic880d80_ring *rx)
+{
+    struct page_pool_params pp = {
+        .flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV,
+        .order = get_order(AIC880D80_RX_HEADROOM + priv->rx_buf_size +
+                           SKB_DATA_ALIGN(sizeof(struct skb_shared_info))),
+        .pool_size = rx->size,
+        .nid = priv->ring_node,
+        .dev = priv->dev,
+        .napi = &priv->napi,
+        .dma_dir = DMA_FROM_DEVICE,
+        .offset = AIC880D80_RX_HEADROOM,
+        .max_len = priv->rx_buf_size,
+    };
+    struct page_pool *pool;
+
+    pool = page_pool_create(&pp);
+    if (IS_ERR(pool))
+        return PTR_ERR(pool);
+
+    WRITE_ONCE(priv->rx_pp, pool);
+    return 0;
+}
+
+/* Pages still held by skbs return to the allocator as they are freed */
+void aic880d80_rx_pp_destroy(struct aic880d80_private *priv)
+{
+    if (!priv->rx_pp)
+        return;
+
+    page_pool_destroy(priv->rx_pp);
+    WRITE_ONCE(priv->rx_pp, NULL);
+}
+
+static int aic880d80_rx_pp_alloc(struct aic880d80_private *priv,
+                                 struct aic880d80_buffer_info *bi, gfp_t gfp)
+{
+    struct page *page;
+
+    page = page_pool_alloc_pages(priv->rx_pp, gfp | __GFP_NOWARN);
+    if (!page)
+        return -ENOMEM;
+
+    bi->page = page;
+    bi->dma = page_pool_get_dma_addr(page) + AIC880D80_RX_HEADROOM;
+    bi->len = priv->rx_buf_size;
+    return 0;
+}
+
+/* Give an empty RX slot a mapped buffer of the kind the ring runs with */
+int aic880d80_rx_alloc_buffer(struct aic880d80_private *priv,
+                              struct aic880d80_buffer_info *bi, gfp_t gfp)
+{
+    struct sk_buff *skb;
+    dma_addr_t dma;
+
+    if (priv->rx_mprq)
+        return aic880d80_rx_mprq_alloc(priv, bi, gfp);
+    if (priv->rx_pp)
+        return aic880d80_rx_pp_alloc(priv, bi, gfp);
+
+    skb = aic880d80_alloc_rx_skb(priv, gfp);
+    if (!skb)
+        return -ENOMEM;
+
+    dma = dma_map_single(priv->dev, skb->data, priv->rx_buf_size,
+                         DMA_FROM_DEVICE);
+    if (dma_mapping_error(priv->dev, dma)) {
+        dev_kfree_skb_any(skb);
+        return -ENOMEM;
+    }
+
+    bi->skb = skb;
+    bi->dma = dma;
+    bi->len = priv->rx_buf_size;
+    priv->rx_dma_maps++;
+    return 0;
+}
+
+/* Unmap and free whatever buffer an idle RX slot still holds */
+void aic880d80_rx_free_buffer(struct aic880d80_private *priv,
+                              struct aic880d80_buffer_info *bi)
+{
+    if (bi->skb) {
+        dma_unmap_single(priv->dev, bi->dma, bi->len, DMA_FROM_DEVICE);
+        dev_kfree_skb_any(bi->skb);
+        bi->skb = NULL;
+        priv->rx_dma_unmaps++;
+    } else if (bi->page && priv->rx_pp) {
+        page_pool_put_full_page(priv->rx_pp, bi->page, false);
+        bi->page = NULL;
+    } else if (bi->page) {
+        aic880d80_rx_mprq_free(priv, bi);
+    }
+}
+
+/*
+ * The device closed the buffer at the RX tail. Keep its page and mapping
+ * for the refill to repost if no skb holds a stride, else leave the page
+ * to the skbs. The strides handed out were synced for the CPU, so a kept
+ * buffer goes back to the device first.
+ */
+static void aic880d80_rx_mprq_retire(struct aic880d80_private *priv,
+                                     struct aic880d80_ring *rx)
+{
+    struct aic880d80_buffer_info *bi = &rx->buf[rx->tail];
+
+    if (page_ref_count(bi->page) == 1) {
+        dma_sync_single_for_device(priv->dev, bi->dma,
+                                   AIC880D80_MPRQ_BUF_SIZE, DMA_FROM_DEVICE);
+        priv->rx_mprq_recycled++;
+    } else {
+        aic880d80_rx_mprq_free(priv, bi);
+        priv->rx_mprq_pinned++;
+    }
+    rx->tail = aic880d80_ring_next(rx, rx->tail);
+    rx->mprq_stride = 0;
+}
+
+static inline bool aic880d80_rx_cqe_valid(const struct aic880d80_ring *rx,
+                                          u32 status)
+{
+    return !!(status & AIC880D80_CQE_PHASE) == rx->cq_phase;
+}
+
+static inline void aic880d80_rx_cq_next(struct aic880d80_ring *rx)
+{
+    if (++rx->cq_head == AIC880D80_MPRQ_CQ_SIZE) {
+        rx->cq_head = 0;
+        rx->cq_phase ^= 1;
+    }
+}
+
+/* Buffers currently handed to the device, tail..head */
+static inline u32 aic880d80_rx_posted(const struct aic880d80_ring *rx)
+{
+    return rx->head >= rx->tail ? rx->head - rx->tail :
+                                  rx->size - rx->tail + rx->head;
+}
+
+/* Number of slots from @from to @to going forward around the ring */
+static inline u32 aic880d80_rx_dist(const struct aic880d80_ring *rx,
+                                    u32 from, u32 to)
+{
+    return to >= from ? to - from : rx->size - from + to;
+}
+
+/*
+ * Top the ring up towards rx_fill_target in whole rx_refill_batch steps,
+ * or immediately when fewer than rx_refill_low buffers are left, and
+ * publish everything with one RX_TAIL write. Dropping below the low
+ * watermark also means traffic is back, so a shrunk target regrows.
+ */
 void aic880d80_alloc_rx_buffers(struct aic880d80_private *priv)
 {
-    while (((priv->rx_head + 1) % AIC880D80_RX_RING_SIZE) != priv->rx_tail) {
-        unsigned int entry = priv->rx_head % AIC880D80_RX_RING_SIZE;
-        struct aic880d80_desc *desc = &priv->rx_ring[entry];
-        if (priv->rx_skbs[entry])
-            break;
-        struct sk_buff *skb = netdev_alloc_skb_ip_align(priv->netdev, AIC880D80_BUFFER_SIZE);
-        if (!skb)
+    struct aic880d80_ring *rx = priv->rx_ring;
+    u32 posted = aic880d80_rx_posted(rx);
+    u32 len = aic880d80_rx_desc_len(priv);
+    u32 head = rx->head;
+    u32 target, want, n;
+
+    target = READ_ONCE(priv->rx_fill_target);
+    if (posted < priv->rx_refill_low && target < priv->rx_refill_high) {
+        target = priv->rx_refill_high;
+        WRITE_ONCE(priv->rx_fill_target, target);
+        priv->rx_regrows++;
+    }
+
+    want = posted < target ? target - posted : 0;
+    if (posted >= priv->rx_refill_low)
+        want = rounddown(want, priv->rx_refill_batch);
+
+    for (n = 0; n < want; n++) {
+        struct aic880d80_desc *desc = &rx->desc[head];
+        struct aic880d80_buffer_info *bi = &rx->buf[head];
+
+        /* A buffer left in place by copybreak or recycled is re-armed */
+        if (!bi->skb && !bi->page &&
+            aic880d80_rx_alloc_buffer(priv, bi, GFP_ATOMIC))
             break;
-        dma_addr_t dma_addr = dma_map_single(&priv->pdev->dev, skb->data, AIC880D80_BUFFER_SIZE, DMA_FROM_DEVICE);
-        if (dma_mapping_error(&priv->pdev->dev, dma_addr)) {
-            dev_kfree_skb(skb);
+        desc->buffer_addr = cpu_to_le64(bi->dma);
+        AIC880D80_DESC_SET_LEN(desc, len);
+        desc->status = cpu_to_le32(AIC880D80_DESC_OWN);
+        head = aic880d80_ring_next(rx, head);
+    }
+
+    WRITE_ONCE(priv->rx_posted, posted + n);
+
+    /* Short of buffers: stop handing strides to skbs so the rest recycle */
+    rx->mprq_copy = posted + n < priv->rx_refill_low;
+    if (!n)
+        return;
+
+    /*
+     * One doorbell per batch. The device does not look past RX_TAIL, so
+     * writel() ordering the batch before it is all the OWN bits need.
+     */
+    rx->head = head;
+    aic880d80_write32(priv, AIC880D80_REG_RX_TAIL, head);
+}
+
+/*
+ * Give back RX buffers beyond the low watermark. Runs from NAPI, which
+ * owns the ring, on behalf of the shrinker. The surplus descriptors are
+ * retracted by lowering RX_TAIL; any the device consumed before the
+ * retract are kept so their frames are still received. In striding mode
+ * that includes the buffer at RX_HEAD: the device may be part way
+ * through it, with entries for its strides already in the completion
+ * queue, and it carries on at the same stride.
+ */
+void aic880d80_rx_shrink(struct aic880d80_private *priv)
+{
+    struct aic880d80_ring *rx = priv->rx_ring;
+    u32 posted = aic880d80_rx_posted(rx);
+    u32 retract, new_head, hw, i, released = 0;
+
+    if (posted > priv->rx_refill_low) {
+        retract = (rx->tail + priv->rx_refill_low) % rx->size;
+        aic880d80_write32_relaxed(priv, AIC880D80_REG_RX_TAIL, retract);
+
+        /* The read also flushes the retract; keep it ordered before the frees */
+        hw = aic880d80_read32(priv, AIC880D80_REG_RX_HEAD);
+        new_head = retract;
+        if (hw < rx->size && aic880d80_rx_dist(rx, retract, hw) <=
+                             aic880d80_rx_dist(rx, retract, rx->head)) {
+            new_head = hw;
+            if (priv->rx_mprq && hw != rx->head)
+                new_head = aic880d80_ring_next(rx, hw);
+        }
+
+        /* The device got past the retract, let RX_TAIL follow it */
+        if (new_head != retract)
+            aic880d80_write32(priv, AIC880D80_REG_RX_TAIL, new_head);
+        rx->head = new_head;
+    }
+
+    /* Every slot outside tail..head is idle, including copybreak leftovers */
+    for (i = rx->head; i != rx->tail; i = aic880d80_ring_next(rx, i)) {
+        struct aic880d80_buffer_info *bi = &rx->buf[i];
+
+        rx->desc[i].status = 0;
+        if (!bi->skb && !bi->page)
+            continue;
+        aic880d80_rx_free_buffer(priv, bi);
+        released++;
+    }
+
+    WRITE_ONCE(priv->rx_posted, aic880d80_rx_posted(rx));
+    priv->rx_shrinks++;
+    priv->rx_bufs_released += released;
+}
+
+/*
+ * Striding RX variant of aic880d80_rx_rearm(): the completion queue
+ * restarts empty and the device at stride 0 of RX_HEAD, so a partly
+ * used tail buffer is retired rather than overwritten under skbs that
+ * may still hold its strides.
+ */
+static void aic880d80_rx_mprq_rearm(struct aic880d80_private *priv)
+{
+    struct aic880d80_ring *rx = priv->rx_ring;
+
+    for (;;) {
+        struct aic880d80_rx_cqe *cqe = &rx->cqe[rx->cq_head];
+        u32 status = le32_to_cpu(cqe->status);
+
+        if (!aic880d80_rx_cqe_valid(rx, status))
             break;
+        if (cqe->length)
+            rx->dropped++;
+        rx->mprq_stride = le16_to_cpu(cqe->stride) + le16_to_cpu(cqe->strides);
+        if (status & AIC880D80_CQE_BUF_DONE)
+            aic880d80_rx_mprq_retire(priv, rx);
+        aic880d80_rx_cq_next(rx);
+    }
+    if (rx->mprq_stride)
+        aic880d80_rx_mprq_retire(priv, rx);
+
+    memset(rx->cqe, 0, sizeof(*rx->cqe) * AIC880D80_MPRQ_CQ_SIZE);
+    rx->cq_head = 0;
+    rx->cq_phase = 1;
+
+    /* Repost what was retired; hw_init() programs the new RX_TAIL */
+    aic880d80_alloc_rx_buffers(priv);
+}
+
+/*
+ * Suspend, with the device and NAPI stopped: frames the device completed
+ * but NAPI never saw are dropped and their buffers handed back, so the
+ * device resumes at RX_HEAD == tail with every posted slot owned by it.
+ * The buffers keep their DMA mappings.
+ */
+void aic880d80_rx_rearm(struct aic880d80_private *priv)
+{
+    struct aic880d80_ring *rx = priv->rx_ring;
+    u32 i;
+
+    if (priv->rx_mprq) {
+        aic880d80_rx_mprq_rearm(priv);
+        return;
+    }
+
+    for (i = rx->tail; i != rx->head; i = aic880d80_ring_next(rx, i)) {
+        struct aic880d80_desc *desc = &rx->desc[i];
+
+        if (le32_to_cpu(desc->status) & AIC880D80_DESC_OWN)
+            continue;
+        AIC880D80_DESC_SET_LEN(desc, aic880d80_rx_desc_len(priv));
+        desc->status = cpu_to_le32(AIC880D80_DESC_OWN);
+        rx->dropped++;
+    }
+}
+
+static unsigned long aic880d80_rx_shrink_count(struct shrinker *shrink,
+                                               struct shrink_control *sc)
+{
+    struct aic880d80_private *priv = shrink->private_data;
+    u32 posted = READ_ONCE(priv->rx_posted);
+
+    /* Pages given back to a page_pool stay cached in it, not freed */
+    if (test_bit(AIC880D80_STATE_DOWN, &priv->state) || READ_ONCE(priv->rx_pp) ||
+        posted <= priv->rx_refill_low)
+        return SHRINK_EMPTY;
+    return posted - priv->rx_refill_low;
+}
+
+/*
+ * The ring belongs to NAPI, so only lower the target and kick it. Nothing
+ * is freed here, and claiming otherwise would have reclaim count pages it
+ * never got; NAPI's release shows up as freed memory on the next pass.
+ */
+static unsigned long aic880d80_rx_shrink_scan(struct shrinker *shrink,
+                                              struct shrink_control *sc)
+{
+    struct aic880d80_private *priv = shrink->private_data;
+
+    if (aic880d80_rx_shrink_count(shrink, sc) != SHRINK_EMPTY) {
+        WRITE_ONCE(priv->rx_fill_target, priv->rx_refill_low);
+        set_bit(AIC880D80_STATE_RX_SHRINK, &priv->state);
+        local_bh_disable();
+        napi_schedule(&priv->napi);
+        local_bh_enable();
+    }
+    return SHRINK_STOP;
+}
+
+int aic880d80_rx_shrinker_init(struct aic880d80_private *priv)
+{
+    struct shrinker *shrink;
+
+    shrink = shrinker_alloc(0, "aic880d80-%s", dev_name(priv->dev));
+    if (!shrink)
+        return -ENOMEM;
+
+    shrink->count_objects = aic880d80_rx_shrink_count;
+    shrink->scan_objects = aic880d80_rx_shrink_scan;
+    shrink->private_data = priv;
+    priv->rx_shrinker = shrink;
+    shrinker_register(shrink);
+    return 0;
+}
+
+void aic880d80_rx_shrinker_exit(struct aic880d80_private *priv)
+{
+    shrinker_free(priv->rx_shrinker);
+    priv->rx_shrinker = NULL;
+}
+
+
+/*
+ * Copy a small frame out of its RX buffer so the mapped buffer can be
+ * re-armed as is, saving an unmap/alloc/map cycle per packet.
+ */
+static struct sk_buff *aic880d80_rx_copybreak(struct aic880d80_private *priv,
+                                              struct aic880d80_buffer_info *bi,
+                                              unsigned int len)
+{
+    void *va = bi->skb ? bi->skb->data :
+                         page_address(bi->page) + AIC880D80_RX_HEADROOM;
+    struct sk_buff *skb;
+
+    skb = napi_alloc_skb(&priv->napi, len);
+    if (!skb)
+        return NULL;
+
+    dma_sync_single_for_cpu(priv->dev, bi->dma, len, DMA_FROM_DEVICE);
+    aic880d80_copy(priv, skb_put(skb, len), va, len);
+    dma_sync_single_for_device(priv->dev, bi->dma, len, DMA_FROM_DEVICE);
+    priv->rx_copybreak_pkts++;
+    return skb;
+}
+
+/*
+ * Build the skb around the page_pool page itself; the page goes back to
+ * the pool when the skb is freed and the slot gets another one.
+ */
+static struct sk_buff *aic880d80_rx_pp_skb(struct aic880d80_private *priv,
+                                           struct aic880d80_buffer_info *bi,
+                                           unsigned int len)
+{
+    struct sk_buff *skb;
+
+    skb = napi_build_skb(page_address(bi->page),
+                         PAGE_SIZE << priv->rx_pp->p.order);
+    if (!skb)
+        return NULL;
+
+    dma_sync_single_for_cpu(priv->dev, bi->dma, len, DMA_FROM_DEVICE);
+    skb_reserve(skb, AIC880D80_RX_HEADROOM);
+    skb_put(skb, len);
+    skb_mark_for_recycle(skb);
+    bi->page = NULL;
+    return skb;
+}
+
+
+/*
+ * L2 forwarding offload: unicast for an offloaded macvlan goes straight
+ * to that device, skipping the macvlan rx_handler lookup on our netdev.
+ */
+static struct net_device *aic880d80_rx_fwd_dev(struct aic880d80_private *priv,
+                                               struct sk_buff *skb)
+{
+    struct net_device *vdev;
+    u32 q;
+
+    for (q = 1; q < AIC880D80_MAX_TX_QUEUES; q++) {
+        vdev = READ_ONCE(priv->fwd_station[q]);
+        if (vdev && ether_addr_equal(skb->data, vdev->dev_addr)) {
+            macvlan_count_rx(netdev_priv(vdev), skb->len, true, false);
+            priv->fwd_rx_steered++;
+            return vdev;
         }
-        desc->buffer = dma_addr;
-        desc->length = AIC880D80_BUFFER_SIZE;
-        desc->status = AIC880D80_DESC_OWN;
-        priv->rx_skbs[entry] = skb;
-        priv->rx_head = (priv->rx_head + 1) % AIC880D80_RX_RING_SIZE;
     }
+    return priv->netdev;
+}
+
+/* First frame since resume: the interface is usable again */
+static void aic880d80_rx_first_after_resume(struct aic880d80_private *priv)
+{
+    u64 elapsed = ktime_get_ns() - priv->pm_resume_start_ns;
+
+    priv->pm_first_rx_ns = elapsed;
+    if (elapsed > priv->pm_first_rx_max_ns)
+        priv->pm_first_rx_max_ns = elapsed;
+    WRITE_ONCE(priv->pm_resume_start_ns, 0);
+    netdev_dbg(priv->netdev, "First RX frame %llu us after resume\n",
+               div_u64(elapsed, NSEC_PER_USEC));
 }
 
+static void aic880d80_rx_deliver(struct aic880d80_private *priv,
+                                 struct sk_buff *skb)
+{
+    skb->protocol = eth_type_trans(skb, READ_ONCE(priv->num_fwd) ?
+                                   aic880d80_rx_fwd_dev(priv, skb) :
+                                   priv->netdev);
+    netif_receive_skb(skb);
+}
 
-void aic880d80_process_rx_ring(struct aic880d80_private *priv, int budget)
+/*
+ * Build the skb for a frame at @offset of a striding buffer. Up to
+ * rx_copybreak it is copied whole, and so is every frame while the ring
+ * is short of buffers; otherwise only the headers are, the rest stays
+ * in the page as a fragment.
+ */
+static struct sk_buff *aic880d80_rx_mprq_skb(struct aic880d80_private *priv,
+                                             struct aic880d80_ring *rx,
+                                             struct aic880d80_buffer_info *bi,
+                                             u32 offset, u32 len, u32 truesize)
 {
+    void *va = page_address(bi->page) + offset;
+    struct sk_buff *skb;
+    u32 headlen = len;
+
+    dma_sync_single_range_for_cpu(priv->dev, bi->dma, offset, len,
+                                  DMA_FROM_DEVICE);
+    if (len > priv->rx_copybreak && !rx->mprq_copy)
+        headlen = eth_get_headlen(priv->netdev, va,
+                                  min_t(u32, len, AIC880D80_RX_HDR_LEN));
+
+    skb = napi_alloc_skb(&priv->napi, headlen);
+    if (!skb)
+        return NULL;
+    aic880d80_copy(priv, __skb_put(skb, headlen), va, headlen);
+
+    if (headlen < len) {
+        get_page(bi->page);
+        skb_add_rx_frag(skb, 0, bi->page, offset + headlen, len - headlen,
+                        truesize);
+    } else {
+        priv->rx_copybreak_pkts++;
+    }
+    return skb;
+}
+
+/* Striding RX: walk the completion queue rather than the descriptors */
+static int aic880d80_process_rx_mprq(struct aic880d80_private *priv, int budget)
+{
+    struct aic880d80_ring *rx = priv->rx_ring;
+    u32 stride_size = priv->rx_mprq_stride;
+    u32 cq_head = rx->cq_head;
+    unsigned int bytes = 0;
     int work_done = 0;
-    while (work_done < budget && priv->rx_tail != priv->rx_head) {
-        unsigned int entry = priv->rx_tail % AIC880D80_RX_RING_SIZE;
-        struct aic880d80_desc *desc = &priv->rx_ring[entry];
-        if (desc->status & AIC880D80_DESC_OWN)
+
+    while (work_done < budget) {
+        struct aic880d80_rx_cqe *cqe = &rx->cqe[rx->cq_head];
+        u32 status = le32_to_cpu(READ_ONCE(cqe->status));
+        struct sk_buff *skb = NULL;
+        u32 len, stride, strides;
+
+        if (!aic880d80_rx_cqe_valid(rx, status))
             break;
-        struct sk_buff *skb = priv->rx_skbs[entry];
-        dma_unmap_single(&priv->pdev->dev, desc->buffer, desc->length, DMA_FROM_DEVICE);
-        skb_put(skb, desc->length);
-        skb->protocol = eth_type_trans(skb, priv->netdev);
-        netif_receive_skb(skb);
-        priv->rx_skbs[entry] = NULL;
-        priv->rx_tail = (priv->rx_tail + 1) % AIC880D80_RX_RING_SIZE;
+        dma_rmb();
+        len = le16_to_cpu(cqe->length);
+        stride = le16_to_cpu(cqe->stride);
+        strides = le16_to_cpu(cqe->strides);
+        rx->mprq_stride = stride + strides;
+
+        if (!len) {
+            priv->rx_mprq_fillers++;
+        } else {
+            if (!(status & AIC880D80_CQE_ERR))
+                skb = aic880d80_rx_mprq_skb(priv, rx, &rx->buf[rx->tail],
+                                            stride * stride_size, len,
+                                            strides * stride_size);
+            if (skb) {
+                aic880d80_rx_deliver(priv, skb);
+                bytes += len;
+            } else {
+                rx->dropped++;
+            }
+            work_done++;
+        }
+
+        /* Entries for a buffer end with BUF_DONE, in ring order */
+        if (status & AIC880D80_CQE_BUF_DONE)
+            aic880d80_rx_mprq_retire(priv, rx);
+        aic880d80_rx_cq_next(rx);
+    }
+
+    if (rx->cq_head != cq_head)
+        aic880d80_write32(priv, AIC880D80_REG_RX_CQ_HEAD, rx->cq_head);
+
+    rx->packets += work_done;
+    rx->bytes += bytes;
+    if (unlikely(READ_ONCE(priv->pm_resume_start_ns)) && work_done)
+        aic880d80_rx_first_after_resume(priv);
+    return work_done;
+}
+
+int aic880d80_process_rx_ring(struct aic880d80_private *priv, int budget)
+{
+    struct aic880d80_ring *rx = priv->rx_ring;
+    u32 tail = rx->tail;
+    unsigned int bytes = 0;
+    int work_done = 0;
+
+    if (priv->rx_mprq)
+        return aic880d80_process_rx_mprq(priv, budget);
+
+    while (work_done < budget && tail != rx->head) {
+        struct aic880d80_desc *desc = &rx->desc[tail];
+        struct aic880d80_buffer_info *bi = &rx->buf[tail];
+        struct sk_buff *skb = bi->skb;
+        unsigned int len;
+
+        if (le32_to_cpu(READ_ONCE(desc->status)) & AIC880D80_DESC_OWN)
+            break;
+        dma_rmb();
+        len = AIC880D80_DESC_GET_LEN(desc);
+        if (len <= priv->rx_copybreak || bi->page) {
+            skb = len <= priv->rx_copybreak ?
+                  aic880d80_rx_copybreak(priv, bi, len) :
+                  aic880d80_rx_pp_skb(priv, bi, len);
+            if (!skb) {
+                /* Buffer stays posted; drop the frame, not the ring slot */
+                rx->dropped++;
+                goto next;
+            }
+        } else {
+            dma_unmap_single(priv->dev, bi->dma, bi->len, DMA_FROM_DEVICE);
+            bi->skb = NULL;
+            priv->rx_dma_unmaps++;
+            skb_put(skb, len);
+        }
+        aic880d80_rx_deliver(priv, skb);
+        bytes += len;
+next:
+        tail = aic880d80_ring_next(rx, tail);
         work_done++;
     }
+
+    rx->tail = tail;
+    rx->packets += work_done;
+    rx->bytes += bytes;
+    if (unlikely(READ_ONCE(priv->pm_resume_start_ns)) && work_done)
+        aic880d80_rx_first_after_resume(priv);
+    return work_done;
 }
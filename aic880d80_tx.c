@@ -1,50 +1,387 @@
 /*
  * aic880d80_tx.c - TX skeleton for AIC 880d80
+ *
+ * The TX ring is a lock-free single-producer/single-consumer queue:
+ *
+ *  - aic880d80_start_xmit() is the only producer and the only writer of
+ *    tx->head. It fills the descriptor, issues dma_wmb() so the body is
+ *    visible before the OWN handoff, then publishes the new head with a
+ *    store-release.
+ *  - aic880d80_clean_tx_ring() is the only consumer and the only writer of
+ *    tx->tail. It load-acquires tx->head before touching any slot and
+ *    store-releases tx->tail once the slots are free again.
+ *  - The queue is stopped while fewer than AIC880D80_TX_DESC_RESERVE
+ *    descriptors are free, so xmit always has room and never returns
+ *    NETDEV_TX_BUSY. Stop/wake use the netif_txq_* helpers, whose memory
+ *    barriers pair with the BQL accounting on both sides.
+ *
+ * Each TX ring maps 1:1 to a netdev TX queue and, with mqprio, to a
+ * traffic class, so the protocol above holds per ring.
+ *
+ * The device writes a descriptor back (OWN clear) and raises TX_DONE only
+ * for descriptors carrying DESC_INT. xmit requests that on the last slot
+ * of a packet when it ends a doorbell batch, when tx_int_desc descriptors
+ * went by without one, or when less than size >> TX_INT_FILL_SHIFT is
+ * free, so a bulk sender gets one writeback and interrupt per batch
+ * rather than per packet, while every doorbell still ends in a report
+ * and nothing waits on a timer. Completion reclaims in whole runs up to
+ * and including the next reported slot whose OWN bit has cleared.
+ *
+ * With the tx-push private flag, a small linear frame that ends an
+ * xmit_more batch is written through the ring's write-combining push
+ * window instead of ringing TAIL. The ring descriptor is still filled in,
+ * since completion works on it as usual.
+ *
+ * In DMA pool mode every slot also has a pre-mapped bounce buffer, and a
+ * frame that fits is copied there instead of being mapped, sparing the
+ * IOMMU an IOVA allocation and an IOTLB invalidation per packet.
  */
 #include "aic880d80.h"
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/bitfield.h>
+#include <linux/udp.h>
+#include <linux/io.h>
+#include <net/netdev_queues.h>
 
 
+/* Free descriptors; safe to call from either side of the ring */
+static inline u32 aic880d80_tx_desc_unused(const struct aic880d80_ring *tx)
+{
+    u32 head = READ_ONCE(tx->head);
+    u32 tail = READ_ONCE(tx->tail);
+
+    return (tail > head ? 0 : tx->size) + tail - head - 1;
+}
+
+
+/* Unmap one TX slot, if mapped; the skb hangs off the last slot of its packet */
+bool aic880d80_unmap_tx_buffer(struct aic880d80_private *priv,
+                               struct aic880d80_buffer_info *bi)
+{
+    if (!bi->len)
+        return false;
+
+    if (bi->frag)
+        dma_unmap_page(priv->dev, bi->dma, bi->len, DMA_TO_DEVICE);
+    else
+        dma_unmap_single(priv->dev, bi->dma, bi->len, DMA_TO_DEVICE);
+    bi->len = 0;
+    return true;
+}
+
+/*
+ * UDP segmentation offload: the device cuts the payload after hdr_len
+ * into gso_size pieces, replicates the headers and fixes up IP/UDP
+ * length and the UDP checksum per segment. The stack has already seeded
+ * uh->check with the length-less pseudo-header sum.
+ */
+static u32 aic880d80_tx_uso(struct sk_buff *skb, struct aic880d80_desc *desc,
+                            unsigned int *bytecount, u16 *segs)
+{
+    unsigned int hdr_len;
+
+    if (!skb_is_gso(skb) || !(skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4))
+        return 0;
+
+    hdr_len = skb_transport_offset(skb) + sizeof(struct udphdr);
+    *segs = skb_shinfo(skb)->gso_segs;
+    *bytecount += (*segs - 1) * hdr_len;
+    desc->seg = cpu_to_le32(FIELD_PREP(AIC880D80_DESC_SEG_MSS,
+                                       skb_shinfo(skb)->gso_size) |
+                            FIELD_PREP(AIC880D80_DESC_SEG_HDRLEN, hdr_len));
+    return AIC880D80_DESC_USO;
+}
+
+/**
+ * aic880d80_tx_push - Hand a descriptor to the device through a push window
+ * @window: the ring's write-combining push window
+ * @desc: descriptor as filled in the ring, OWN included
+ * @slot: ring index of @desc
+ * @data: start of the frame
+ * @inline_len: frame bytes to push along, at most AIC880D80_PUSH_INLINE_MAX
+ *
+ * Stands in for the TAIL doorbell, so every earlier descriptor must be
+ * complete in memory; the wmb() orders them before the WC stores.
+ */
+void aic880d80_tx_push(void __iomem *window, const struct aic880d80_desc *desc,
+                       u32 slot, const void *data, u32 inline_len)
+{
+    struct {
+        struct aic880d80_desc desc;
+        u8 data[AIC880D80_PUSH_INLINE_MAX];
+    } block;
+
+    block.desc = *desc;
+    block.desc.push = cpu_to_le32(FIELD_PREP(AIC880D80_DESC_PUSH_SLOT, slot) |
+                                  FIELD_PREP(AIC880D80_DESC_PUSH_INLINE,
+                                             inline_len));
+    memcpy(block.data, data, inline_len);
+
+    wmb();
+    __iowrite64_copy(window, &block,
+                     DIV_ROUND_UP(sizeof(*desc) + inline_len, sizeof(u64)));
+    /* Don't let the next push merge into this burst */
+    io_stop_wc();
+}
+
+/*
+ * Ask for a completion on slot @eop and return the flag for its status.
+ * The device may fetch ahead of the doorbell and never rereads a slot it
+ * owns, so this must precede the SOP hand-off, and the flag must precede
+ * the store-release of head for the completion side to see it.
+ */
+static u32 aic880d80_tx_report(struct aic880d80_ring *tx, u32 eop)
+{
+    WRITE_ONCE(tx->buf[eop].report, true);
+    tx->since_report = 0;
+    tx->reports++;
+    return AIC880D80_DESC_INT;
+}
+
+/* Push only single-buffer frames that end a batch, so the push is the doorbell */
+static bool aic880d80_tx_want_push(struct aic880d80_private *priv,
+                                   struct aic880d80_ring *tx, struct sk_buff *skb)
+{
+    return tx->push &&
+           (READ_ONCE(priv->priv_flags) & AIC880D80_PRIV_FLAG_TX_PUSH) &&
+           !skb_shinfo(skb)->nr_frags && !skb_is_gso(skb) &&
+           !netdev_xmit_more();
+}
+
+/* Bounce through the slot's pool buffer instead of mapping the frame */
+static bool aic880d80_tx_want_copy(struct aic880d80_private *priv,
+                                   const struct aic880d80_buffer_info *bi,
+                                   struct sk_buff *skb)
+{
+    return bi->pool_va && !skb_is_gso(skb) && skb->len <= priv->tx_copybreak;
+}
+
 netdev_tx_t aic880d80_start_xmit(struct sk_buff *skb, struct net_device *netdev)
 {
     struct aic880d80_private *priv = netdev_priv(netdev);
-    unsigned int entry = priv->tx_head % AIC880D80_TX_RING_SIZE;
-    struct aic880d80_desc *desc = &priv->tx_ring[entry];
+    u16 queue = skb_get_queue_mapping(skb);
+    struct netdev_queue *txq = netdev_get_tx_queue(netdev, queue);
+    struct aic880d80_ring *tx = priv->tx_ring[queue];
+    unsigned int nr_frags = skb_shinfo(skb)->nr_frags;
+    u32 first = tx->head, head = first, i;
+    struct aic880d80_desc *desc = &tx->desc[first];
+    struct aic880d80_buffer_info *bi;
+    unsigned int bytecount = skb->len;
+    unsigned int len = skb_headlen(skb);
     dma_addr_t dma_addr;
+    u32 status, eop_status, eop, unused, inline_len = 0;
+    bool push, unmapped, mapped, kick;
+    u16 segs = 1;
 
-    if (((priv->tx_head + 1) % AIC880D80_TX_RING_SIZE) == priv->tx_tail) {
-        netif_stop_queue(netdev);
-        return NETDEV_TX_BUSY;
+    /* The stop threshold guarantees room; running out is a driver bug */
+    if (WARN_ON_ONCE(aic880d80_tx_desc_unused(tx) < nr_frags + 1)) {
+        netif_tx_stop_queue(txq);
+        goto drop;
     }
 
-    dma_addr = dma_map_single(&priv->pdev->dev, skb->data, skb->len, DMA_TO_DEVICE);
-    if (dma_mapping_error(&priv->pdev->dev, dma_addr)) {
-        dev_kfree_skb(skb);
-        return NETDEV_TX_OK;
+    /* No checksum engine outside USO: resolve CHECKSUM_PARTIAL here */
+    if (!skb_is_gso(skb) && aic880d80_tx_csum(priv, skb))
+        goto drop;
+
+    /* SOP-only fields: segmentation and launch time */
+    status = AIC880D80_DESC_SOP | aic880d80_tx_uso(skb, desc, &bytecount, &segs);
+
+    /* ETF offload: the device holds the frame until its launch time */
+    if (skb->tstamp && test_bit(queue, &priv->tx_launch_queues)) {
+        u64 launch = ktime_to_ns(skb->tstamp) - READ_ONCE(priv->launch_offset_ns);
+
+        desc->launch_lo = cpu_to_le32(lower_32_bits(launch));
+        desc->launch_hi = cpu_to_le32(upper_32_bits(launch));
+        status |= AIC880D80_DESC_LAUNCH;
+    }
+
+    /* A frame that fits in the push block entirely is never DMA mapped */
+    push = aic880d80_tx_want_push(priv, tx, skb);
+    if (push)
+        inline_len = min_t(u32, len, AIC880D80_PUSH_INLINE_MAX);
+    unmapped = push && inline_len == len;
+
+    bi = &tx->buf[first];
+    mapped = false;
+    if (unmapped) {
+        dma_addr = 0;
+    } else if (aic880d80_tx_want_copy(priv, bi, skb)) {
+        /* Linearised into one pre-mapped slot, so a single descriptor */
+        skb_copy_bits(skb, 0, bi->pool_va, skb->len);
+        dma_sync_single_for_device(priv->dev, bi->pool_dma, skb->len,
+                                   DMA_TO_DEVICE);
+        nr_frags = 0;
+        len = skb->len;
+        dma_addr = bi->pool_dma;
+        tx->pool_copies++;
+    } else {
+        dma_addr = dma_map_single(priv->dev, skb->data, len, DMA_TO_DEVICE);
+        mapped = true;
+    }
+
+    for (i = 0; ; i++) {
+        if (mapped && dma_mapping_error(priv->dev, dma_addr))
+            goto unmap;
+
+        bi = &tx->buf[head];
+        bi->dma = dma_addr;
+        bi->len = mapped ? len : 0;
+        bi->frag = i > 0;
+        desc = &tx->desc[head];
+        desc->buffer_addr = cpu_to_le64(dma_addr);
+        AIC880D80_DESC_SET_LEN(desc, len);
+
+        /*
+         * Middle slots go to the device now, the SOP hand-off publishes
+         * all; the EOP status waits for the report decision below.
+         */
+        if (i && i < nr_frags)
+            desc->status = cpu_to_le32(AIC880D80_DESC_OWN);
+
+        if (i == nr_frags)
+            break;
+
+        head = aic880d80_ring_next(tx, head);
+        len = skb_frag_size(&skb_shinfo(skb)->frags[i]);
+        dma_addr = skb_frag_dma_map(priv->dev,
+                                    &skb_shinfo(skb)->frags[i], 0, len,
+                                    DMA_TO_DEVICE);
+        mapped = true;
     }
 
-    desc->buffer = dma_addr;
-    desc->length = skb->len;
-    desc->status = AIC880D80_DESC_OWN;
-    priv->tx_skbs[entry] = skb;
-    priv->tx_head = (priv->tx_head + 1) % AIC880D80_TX_RING_SIZE;
+    /* Completion accounting lives on the last slot */
+    eop = head;
+    bi->skb = skb;
+    bi->bytecount = bytecount;
+    bi->segs = segs;
+
+    /*
+     * Ring the doorbell at the end of an xmit_more batch, or earlier if
+     * BQL or the ring-space check below stops the queue. Either way the
+     * frame must then be reported, or the stack could wait on completions
+     * that are never written back. The device cannot see the packet yet,
+     * so DESC_INT still goes into the EOP status before the hand-off.
+     */
+    unused = aic880d80_tx_desc_unused(tx) - (nr_frags + 1);
+    kick = __netdev_tx_sent_queue(txq, bytecount, netdev_xmit_more()) ||
+           unused < AIC880D80_TX_DESC_RESERVE;
+    tx->since_report += nr_frags + 1;
+    eop_status = AIC880D80_DESC_EOP;
+    if (kick || tx->since_report >= READ_ONCE(priv->tx_int_desc) ||
+        unused < tx->size >> AIC880D80_TX_INT_FILL_SHIFT)
+        eop_status |= aic880d80_tx_report(tx, eop);
+    if (eop == first)
+        status |= eop_status;
+    else
+        tx->desc[eop].status = cpu_to_le32(eop_status | AIC880D80_DESC_OWN);
 
-    /* Trigger TX (write to hardware register if needed) */
-    aic880d80_write32(priv, AIC880D80_REG_TX_CTRL, 1);
+    /* Every descriptor body must be visible before the SOP OWN bit */
+    dma_wmb();
+    tx->desc[first].status = cpu_to_le32(status | AIC880D80_DESC_OWN);
+
+    tx->dma_maps += nr_frags + !!tx->buf[first].len;
+    if (segs > 1) {
+        tx->uso_packets++;
+        tx->uso_segs += segs;
+    }
+
+    /* Publish the slots, report flag included, to the completion side */
+    head = aic880d80_ring_next(tx, head);
+    smp_store_release(&tx->head, head);
+
+    if (netif_txq_maybe_stop(txq, aic880d80_tx_desc_unused(tx),
+                             AIC880D80_TX_DESC_RESERVE,
+                             AIC880D80_TX_WAKE_THRESH) <= 0)
+        tx->stops++;
+
+    if (!kick)
+        return NETDEV_TX_OK;
 
+    if (push) {
+        aic880d80_tx_push(tx->push, &tx->desc[first], first, skb->data,
+                          inline_len);
+        tx->pushes++;
+    } else {
+        /* Ordered write: the descriptors above must land first */
+        aic880d80_write32(priv, AIC880D80_REG_TXQ(queue, AIC880D80_TXQ_TAIL),
+                         head);
+    }
+
+    return NETDEV_TX_OK;
+
+unmap:
+    /* Undo the i slots mapped before the failing one, newest first */
+    while (i--) {
+        head = head ? head - 1 : tx->size - 1;
+        aic880d80_unmap_tx_buffer(priv, &tx->buf[head]);
+        tx->desc[head].status = 0;
+    }
+drop:
+    dev_kfree_skb_any(skb);
+    tx->dropped++;
     return NETDEV_TX_OK;
 }
 
-void aic880d80_clean_tx_ring(struct aic880d80_private *priv)
+void aic880d80_clean_tx_ring(struct aic880d80_ring *tx)
 {
-    while (priv->tx_tail != priv->tx_head) {
-        unsigned int entry = priv->tx_tail % AIC880D80_TX_RING_SIZE;
-        struct aic880d80_desc *desc = &priv->tx_ring[entry];
-        if (desc->status & AIC880D80_DESC_OWN)
+    struct aic880d80_private *priv = tx->priv;
+    struct netdev_queue *txq = netdev_get_tx_queue(priv->netdev, tx->queue_index);
+    u32 head = smp_load_acquire(&tx->head);
+    u32 tail = tx->tail, done;
+    unsigned int pkts = 0, frames = 0, bytes = 0;
+
+    while (tail != head) {
+        /* Only reported slots are written back; find the next one */
+        for (done = tail; done != head && !READ_ONCE(tx->buf[done].report);
+             done = aic880d80_ring_next(tx, done))
+            ;
+        if (done == head ||
+            le32_to_cpu(READ_ONCE(tx->desc[done].status)) & AIC880D80_DESC_OWN)
             break;
-        dma_unmap_single(&priv->pdev->dev, desc->buffer, desc->length, DMA_TO_DEVICE);
-        dev_kfree_skb(priv->tx_skbs[entry]);
-        priv->tx_tail = (priv->tx_tail + 1) % AIC880D80_TX_RING_SIZE;
+
+        /* Release the buffers only after seeing OWN clear */
+        dma_rmb();
+
+        done = aic880d80_ring_next(tx, done);
+        do {
+            struct aic880d80_buffer_info *bi = &tx->buf[tail];
+
+            tx->dma_unmaps += aic880d80_unmap_tx_buffer(priv, bi);
+            bi->report = false;
+            if (bi->skb) {
+                pkts++;
+                frames += bi->segs;
+                bytes += bi->bytecount;
+                dev_consume_skb_any(bi->skb);
+                bi->skb = NULL;
+            }
+            tail = aic880d80_ring_next(tx, tail);
+        } while (tail != done);
     }
+
+    if (tail == tx->tail)
+        return;
+
+    /* Hand the freed slots back to the producer */
+    smp_store_release(&tx->tail, tail);
+
+    tx->packets += frames;
+    tx->bytes += bytes;
+
+    /* Never wake a queue that is going down or being reset */
+    __netif_txq_completed_wake(txq, pkts, bytes, aic880d80_tx_desc_unused(tx),
+                               AIC880D80_TX_WAKE_THRESH,
+                               READ_ONCE(priv->state) &
+                               (BIT(AIC880D80_STATE_DOWN) |
+                                BIT(AIC880D80_STATE_TX_RESET)));
+}
+
+/* TX completion is a single interrupt for all rings */
+void aic880d80_clean_tx_rings(struct aic880d80_private *priv)
+{
+    u32 q;
+
+    for (q = 0; q < priv->num_tx_rings; q++)
+        aic880d80_clean_tx_ring(priv->tx_ring[q]);
 }
@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Layout check for AIC semi AIC 880d80 driver data structures
+# Copyright (C) 2025 Zero Day Security Research
+#
+# Uses pahole to verify that the producer and consumer sides of
+# struct aic880d80_ring sit on different cache lines, and that neither
+# shares a line with the read-mostly ring fields.
+#
+# Usage: check-layout.sh <module.ko> [cache-line-size]
+#
+
+MODULE="$1"
+CACHE_LINE="${2:-64}"
+
+if [ -z "$MODULE" ] || [ ! -f "$MODULE" ]; then
+    echo "Usage: $0 <module.ko> [cache-line-size]"
+    exit 1
+fi
+
+if ! command -v pahole >/dev/null 2>&1; then
+    echo "check-layout: pahole not found, skipping layout check"
+    exit 0
+fi
+
+LAYOUT=$(pahole -C aic880d80_ring "$MODULE" 2>/dev/null)
+if [ -z "$LAYOUT" ]; then
+    echo "check-layout: no debug info in $MODULE, skipping layout check"
+    exit 0
+fi
+
+# Print the cache line holding a member, from pahole's /* offset size */
+member_line() {
+    echo "$LAYOUT" | awk -v m="$1" -v cl="$CACHE_LINE" '
+        {
+            for (i = 1; i <= NF; i++) {
+                name = $i
+                sub(/;$/, "", name)
+                sub(/^\*+/, "", name)
+                if (name == m && match($0, /\/\* *[0-9]+ +[0-9]+ *\*\//)) {
+                    split(substr($0, RSTART + 2, RLENGTH - 4), f, " ")
+                    print int(f[1] / cl)
+                    exit
+                }
+            }
+        }'
+}
+
+DESC=$(member_line desc)
+HEAD=$(member_line head)
+TAIL=$(member_line tail)
+
+if [ -z "$DESC" ] || [ -z "$HEAD" ] || [ -z "$TAIL" ]; then
+    echo "check-layout: could not locate ring members in pahole output"
+    exit 1
+fi
+
+FAIL=0
+if [ "$HEAD" = "$TAIL" ]; then
+    echo "check-layout: producer and consumer share cache line $HEAD"
+    FAIL=1
+fi
+if [ "$HEAD" = "$DESC" ] || [ "$TAIL" = "$DESC" ]; then
+    echo "check-layout: ring index shares cache line $DESC with read-mostly fields"
+    FAIL=1
+fi
+
+if [ "$FAIL" -ne 0 ]; then
+    echo "$LAYOUT"
+    exit 1
+fi
+
+echo "check-layout: struct aic880d80_ring OK (read-mostly line $DESC, head line $HEAD, tail line $TAIL)"
+exit 0
@@ -137,23 +137,16 @@ ethtool -G "$INTERFACE" rx 512 tx 512 2>/dev/null || true
 ethtool -K "$INTERFACE" gso on gro on tso on 2>/dev/null || true
 ethtool -K "$INTERFACE" rx-checksum on tx-checksum-ip-generic on 2>/dev/null || true
 
-# Set interrupt coalescing for ARM64
-ethtool -C "$INTERFACE" rx-usecs 50 rx-frames 64 2>/dev/null || true
-ethtool -C "$INTERFACE" tx-usecs 50 tx-frames 64 2>/dev/null || true
+# Request a TX completion every 64 descriptors, the only coalescing knob
+if ! ethtool -C "$INTERFACE" tx-frames 64; then
+    echo "Failed to set TX completion coalescing on $INTERFACE"
+fi
 
 # Set optimal buffer sizes
 echo 2097152 > /proc/sys/net/core/rmem_max 2>/dev/null || true
 echo 2097152 > /proc/sys/net/core/wmem_max 2>/dev/null || true
 
-# ARM64 specific CPU affinity (if multiple cores available)
-CORES=$(nproc)
-if [ "$CORES" -gt 1 ]; then
-    # Distribute interrupts across available cores
-    IRQ=$(cat /proc/interrupts | grep "$INTERFACE" | awk '{print $1}' | tr -d ':')
-    if [ -n "$IRQ" ]; then
-        echo 2 > "/proc/irq/$IRQ/smp_affinity" 2>/dev/null || true
-    fi
-fi
+# IRQ affinity and XPS are set by the driver at open (see debugfs "queues")
 
 echo "ARM64 optimization completed for $INTERFACE"
 EOF